@@ -51,10 +51,13 @@ struct CommandEntry {
     char *long_help;
 };
 
+#define BENCH_DEPTH 10 /* default depth of the search benchmark */
+
 extern char AutoSaveFileName[64];
 
 struct Command *ParseInput(char *line);
 void ExecuteCommand(struct Command *theCommand);
 void NewGame(char *);
+void SearchBench(int depth, int threads);
 
 #endif
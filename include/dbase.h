@@ -121,6 +121,7 @@ struct Position {
     BitBoard slidingPieces;
     hash_t hkey;
     hash_t pkey;
+    hash_t mkey; /* material key, see MaterialKey() */
     struct GameLog *gameLog;
     struct GameLog *actLog;
     unsigned int gameLogSize;
@@ -143,6 +144,7 @@ struct GameLog {
     uint8_t gl_IrrevCount; /* number of moves since last irreversible move */
     hash_t gl_HashKey;     /* used to detect repetitions */
     hash_t gl_PawnKey;
+    hash_t gl_MaterialKey;
 };
 
 extern int Value[];
@@ -45,6 +45,17 @@ struct PawnFacts {
     char pf_BlackQueenSide;
 };
 
+/*
+ * Evaluation terms which depend on the material only, see
+ * EvaluateMaterialHashed().
+ */
+struct MaterialFacts {
+    int mf_Score; /* bishop pairs */
+    int mf_Flags;
+    int mf_WhitePhase;
+    int mf_BlackPhase;
+};
+
 /**
  * Pawn evaluation parameters
  */
@@ -0,0 +1,82 @@
+/*
+
+    Amy - a chess playing program
+
+    Copyright (c) 2002-2025, Thorsten Greiner
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/*
+ * hashmem.h - memory management for the hash tables
+ */
+
+#ifndef HASHMEM_H
+#define HASHMEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_LINE_SIZE 64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+enum HashBacking {
+    HB_NONE,
+    HB_HEAP,
+    HB_PAGES,
+    HB_TRANSPARENT_HUGE_PAGES,
+    HB_HUGE_PAGES,
+    HB_FILE
+};
+
+/*
+ * A block of memory backing a hash table. 'hm_Base' and 'hm_Size' describe
+ * the underlying allocation, which may be larger than requested because of
+ * alignment.
+ */
+struct HashMemory {
+    void *hm_Base;
+    size_t hm_Size;
+    enum HashBacking hm_Backing;
+};
+
+/*
+ * A job run by RunHashJob() on the range [start, end) as its slice 'slice'.
+ */
+typedef void (*HashJob)(void *arg, int slice, uint64_t start, uint64_t end);
+
+extern bool UseHugePages;
+extern bool UseParallelFirstTouch;
+
+void *AllocateHashMemory(struct HashMemory *, size_t);
+void *MapHashFile(struct HashMemory *, int, size_t, size_t);
+void FreeHashMemory(struct HashMemory *);
+int HashJobSlices(void);
+void RunHashJob(HashJob, void *, uint64_t, uint64_t, int);
+void ClearHashMemory(void *, size_t);
+const char *HashBackingName(enum HashBacking);
+
+#endif
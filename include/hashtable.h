@@ -51,55 +51,155 @@ typedef enum {
     LowerBound,
     UpperBound,
     Useful,
-    Useless,
-    OnEvaluation
+    Useless
 } LookupResult;
 
+typedef enum { IF_ENTERED, IF_BUSY, IF_UNTRACKED } InFlightResult;
+
+/* Transposition table events counted by remaining depth, see CountHT(). */
+typedef enum {
+    HS_Probes,
+    HS_Hits,
+    HS_ExactCutoffs,
+    HS_LowerCutoffs,
+    HS_UpperCutoffs,
+    HS_Stores,
+    HS_Replaced,
+    HS_IllegalMoves,
+    HS_Count
+} HTStat;
+
+/* Rows of the transposition table statistics, one per ply of depth */
+#define HT_STATS_DEPTHS 32
+
+#if MP && HAVE_LIBPTHREAD
+#define THREAD_LOCAL _Thread_local
+#else
+#define THREAD_LOCAL
+#endif
+
+/*
+ * Search statistics. Each search thread counts into its own copy, which
+ * lives in its SearchData, and the master sums them up when it reports.
+ * Holds only unsigned long counters, see AddSearchStats().
+ */
+struct SearchStats {
+    unsigned long ss_HTry, ss_HHit, ss_HIllegal;
+    unsigned long ss_PTry, ss_PHit, ss_STry, ss_SHit;
+    unsigned long ss_RCExt, ss_ChkExt, ss_DiscExt, ss_DblExt;
+    unsigned long ss_SingExt, ss_PPExt, ss_ZZExt;
+    unsigned long ss_EGTBProbe, ss_EGTBProbeSucc;
+    unsigned long ss_HT[HT_STATS_DEPTHS][HS_Count];
+};
+
+/*
+ * A transposition table entry. Move, score, depth and flags are packed
+ * into the data word (see hashtable.c). The hash key is stored XOR'ed
+ * with the data word, so an entry torn by concurrent writers fails the
+ * key comparison and is simply treated as a miss.
+ */
 struct HTEntry {
-    unsigned int ht_Signature;
-    move_t ht_Move;
-    int ht_Score;
-    short ht_Flags;
-    short ht_Depth;
+    hash_t ht_Key;
+    uint64_t ht_Data;
+};
+
+#define HT_BUCKET_SIZE 4
+
+/*
+ * The transposition table is organized in buckets of HT_BUCKET_SIZE
+ * entries. A bucket fills exactly one 64 byte cache line.
+ */
+struct HTBucket {
+    struct HTEntry hb_Entries[HT_BUCKET_SIZE];
 };
 
+/*
+ * A pawn table entry. The score and the PawnFacts are packed into three
+ * words together with a 40 bit signature (see hashtable.c). Passed pawns
+ * are on ranks 2 to 7 and fit into 48 bits.
+ */
 struct PTEntry {
-    unsigned int pt_Signature;
-    int pt_Score;
-    struct PawnFacts pt_PawnFacts;
+    uint64_t pt_Key;   /* signature, score and white queen side */
+    uint64_t pt_White; /* white passers, flags and white king side */
+    uint64_t pt_Black; /* black passers, black king and queen side */
+};
+
+/*
+ * A material table entry holds a 32 bit signature and the MaterialFacts
+ * in a single word.
+ */
+struct MTEntry {
+    uint64_t mt_Key;
 };
 
+/*
+ * A score table entry holds a 48 bit signature and a 16 bit score in a
+ * single word, so it is always read and written as a whole.
+ */
 struct STEntry {
-    unsigned int st_Signature;
-    int st_Score;
+    uint64_t st_Key;
 };
 
 extern hash_t HashKeys[2][8][64];
 extern hash_t HashKeysEP[64];
 extern hash_t HashKeysCastle[16];
 extern hash_t STMKey;
-
-extern OPTIONAL_ATOMIC unsigned long PHit, PTry, SHit, STry, HHit, HTry;
-extern int L_HT_Bits, L_HT_Size, L_HT_Mask;
+extern hash_t MaterialKeys[2][8];
+
+/* The statistics of the calling thread, see UseSearchStats() */
+extern THREAD_LOCAL struct SearchStats *ThreadStats;
+
+/**
+ * Map the upper 48 bits of 'key' onto [0, size). Unlike masking this works
+ * for sizes which are not a power of two, and it leaves the lower 16 bits
+ * of the key independent of the index.
+ */
+static inline uint64_t HashIndex(hash_t key, uint64_t size) {
+#if defined(__SIZEOF_INT128__)
+    return (uint64_t)(((unsigned __int128)(key >> 16) * size) >> 48);
+#else
+    return (key >> 16) % size;
+#endif
+}
 
 void ClearHashTable(void);
 void AgeHashTable(void);
 void ClearPawnHashTable(void);
 void AllocateHT(void);
-#if MP
-LookupResult ProbeHT(hash_t, int *, int, move_t *, bool *, int, int,
-                     struct HTEntry *);
-void StoreHT(hash_t, int, int, int, int, int, int, int, struct HTEntry *);
-#else
+void ResizeHT(char *, bool);
+bool SaveHT(const char *);
+bool LoadHT(const char *);
 LookupResult ProbeHT(hash_t, int *, int, move_t *, bool *, int);
 void StoreHT(hash_t, int, int, int, int, int, int, int);
+void PrefetchHT(hash_t);
+void PrefetchPT(hash_t);
+void PrefetchST(hash_t);
+#if MP
+InFlightResult EnterInFlight(hash_t, int, bool);
+void LeaveInFlight(hash_t, int);
+#endif
+#if MP && HAVE_LIBPTHREAD
+struct EvalCache;
+extern bool LocalEvalCaches;
+struct EvalCache *GetEvalCache(int);
+void UseEvalCache(struct EvalCache *);
 #endif
 LookupResult ProbePT(hash_t, int *, struct PawnFacts *);
 void StorePT(hash_t, int, struct PawnFacts *);
 LookupResult ProbeST(hash_t, int *);
 void StoreST(hash_t, int);
+LookupResult ProbeMT(hash_t, struct MaterialFacts *);
+void StoreMT(hash_t, const struct MaterialFacts *);
 void ShowHashStatistics(void);
+void UseSearchStats(struct SearchStats *);
+void AddSearchStats(struct SearchStats *, const struct SearchStats *);
+void CountHT(HTStat, int);
+void AddHTStatistics(const struct SearchStats *);
+void ShowHTDepthStatistics(int);
+bool WriteHTStatistics(const char *);
+void SetHTStatisticsFile(const char *);
 void GuessHTSizes(char *);
+uint64_t HTTotalSize(void);
 void HashInit(void);
 
 #endif
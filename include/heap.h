@@ -98,6 +98,12 @@ static inline void pop_section(heap_t heap) {
     heap->current_section--;
 }
 
+static inline void clear_heap(heap_t heap) {
+    heap->current_section = heap->sections_start;
+    heap->current_section->start = 0;
+    heap->current_section->end = 0;
+}
+
 heap_t allocate_heap(void);
 void free_heap(heap_t heap);
 
@@ -33,6 +33,8 @@
 #define NEXT_H
 
 #include "config.h"
+#include "hashmem.h"
+#include "hashtable.h"
 #include "heap.h"
 #include "types.h"
 #include <stdbool.h>
@@ -56,6 +58,7 @@ typedef enum {
 struct SearchStatus {
     SearchPhase st_phase;
     move_t st_hashmove;
+    int st_depth; /* remaining depth, for the hashtable statistics */
     move_t st_k1, st_k2, st_kl, st_cm, st_k3;
 };
 
@@ -72,8 +75,8 @@ struct SearchData {
     struct KillerEntry *killer;
     struct KillerEntry *killerTable;
 #if MP
-    struct HTEntry *localHashTable;
     heap_t deferred_heap;
+    struct EvalCache *evalCache; /* private pawn and score tables or NULL */
 #endif
 
     heap_t heap;
@@ -87,7 +90,8 @@ struct SearchData {
 
     uint16_t ply;
 
-    bool master; /* true if a master process */
+    bool master;   /* true if a master process */
+    int thread_id; /* 0 for the master, 1... for the helpers */
     unsigned long nodes_cnt, qnodes_cnt, check_nodes_cnt;
 
     move_t best_move;
@@ -95,10 +99,16 @@ struct SearchData {
 
     uint16_t nrootmoves;
     uint16_t movenum;
+
+    void *allocation; /* the memory block holding this SearchData */
+
+    /* on cache lines of its own, as it is written at every node */
+    _Alignas(CACHE_LINE_SIZE) struct SearchStats stats;
 };
 
 struct SearchData *CreateSearchData(struct Position *);
 void FreeSearchData(struct SearchData *);
+void ResetSearchData(struct SearchData *, struct Position *);
 void EnterNode(struct SearchData *);
 void LeaveNode(struct SearchData *);
 int NextMove(struct SearchData *);
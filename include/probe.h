@@ -34,8 +34,6 @@
 
 #include "dbase.h"
 
-extern int EGTBProbe, EGTBProbeSucc;
-
 void InitEGTB(char *);
 int ProbeEGTB(const struct Position *, int *, int);
 
@@ -43,6 +43,7 @@
 #define ON_EVALUATION (INF + 1)
 
 #define MAX_TREE_SIZE 64 /* maximum depth we will search to */
+#define MAX_MULTI_PV 16  /* maximum number of principal variations */
 
 typedef enum {
     PB_NO_PB_MOVE = 0,
@@ -52,6 +53,9 @@ typedef enum {
 
 } pb_result_t;
 
+/* The parallel search algorithm */
+typedef enum { SMP_ABDADA = 0, SMP_LAZY } smp_mode_t;
+
 extern int ExtendInCheck;
 extern int ExtendDoubleCheck;
 extern int ExtendDiscoveredCheck;
@@ -64,17 +68,28 @@ extern int16_t ExtendRecapture[];
 
 extern unsigned int FHTime;
 extern bool AbortSearch;
+extern int MultiPV;
+extern int DepthLimit;
+extern unsigned long NodeLimit;
 
 #if MP
 extern int NumberOfCPUs;
+extern smp_mode_t ParallelMode;
 #endif
 
 int Iterate(struct Position *);
 void SearchRoot(struct Position *);
 void AnalysisMode(struct Position *);
 pb_result_t PermanentBrain(struct Position *);
+int SearchDepthTime(int);
+int SearchToDepth(struct Position *, int, unsigned long *);
+void ShowMultiPV(void);
 #if MP
 void StopHelpers(void);
+void ForgetHelpers(void);
+bool RunOnHelpers(void (*)(void *, int), void *, int);
+const char *ParallelModeName(smp_mode_t);
+bool ParseParallelMode(const char *, smp_mode_t *);
 #endif
 
 #endif
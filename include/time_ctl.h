@@ -39,6 +39,7 @@ extern int Moves[3], Time[3];
 extern int Increment;
 extern int TMoves2, TTime2;
 extern int TwoTimeControls;
+extern int MoveOverhead;
 
 void DoTC(struct Position *, int);
 void CalcTime(struct Position *, float *, float *);
@@ -32,15 +32,47 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include "config.h"
+#include <stdbool.h>
 #include <stddef.h>
 
-#define ONE_SECOND 100u
+#if HAVE_LIBPTHREAD && HAVE_STDATOMIC_H
+#include <stdatomic.h>
+#define INPUT_THREAD 1
+#else
+#define INPUT_THREAD 0
+#endif
+
+#define ONE_SECOND 1000u /* GetTime() ticks per second */
+
+/* Convert GetTime() ticks to centiseconds, the time unit of xboard. */
+#define CENTISECONDS(t) ((t) / (ONE_SECOND / 100))
 
 extern int Verbosity;
 
+#if INPUT_THREAD
+extern atomic_bool InputPending;
+#endif
+
+/**
+ * Check whether the input thread has queued a line. This is cheap enough
+ * to be done at every node.
+ */
+static inline bool InputWaiting(void) {
+#if INPUT_THREAD
+    return atomic_load_explicit(&InputPending, memory_order_relaxed);
+#else
+    return false;
+#endif
+}
+
 void OpenLogFile(char *name);
+void CloseLogFile(void);
 void Print(int, char *, ...);
 void PrintNoLog(int, char *, ...);
+void StartInputThread(void);
+void IgnoreInput(bool);
+void DetachInput(void);
 int InputReady(void);
 int ReadLine(char *buffer, int cnt);
 char *FormatTime(unsigned int, char *, size_t);
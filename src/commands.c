@@ -43,19 +43,29 @@
 #include "eco.h"
 #include "evaluation.h"
 #include "evaluation_config.h"
+#include "hashtable.h"
 #include "heap.h"
 #include "inline.h"
 #include "next.h"
+#include "perft.h"
 #include "pgn.h"
 #include "search.h"
 #include "state_machine.h"
 #include "time_ctl.h"
 #include "utils.h"
 
+#if HAVE_FORK
+#include <sys/wait.h>
+#include <unistd.h>
+#endif /* HAVE_FORK */
+
 static void Quit(char *);
 static void Show(char *);
 static void ShowEco(char *);
 static void Test(char *);
+#if HAVE_FORK
+static void ParallelTest(char *);
+#endif /* HAVE_FORK */
 static void SetTime(char *);
 static void SetXBoard(char *);
 static void Go(char *);
@@ -76,12 +86,20 @@ static void ShowWarranty(char *);
 static void ShowDistribution(char *);
 static void Help(char *);
 static void Benchmark(char *);
-static void Perft(char *);
+static void SearchBenchCmd(char *);
+static void PerftCmd(char *);
+static void PerftHash(char *);
 static void Load(char *);
 static void Save(char *);
 static void Prefs(char *);
 static void Flatten(char *);
 static void XboardTime(char *);
+static void XboardOtim(char *);
+static void SetMoveOverhead(char *);
+static void MultiPVCmd(char *);
+static void SetDepthLimit(char *);
+static void SetNodeLimit(char *);
+static void XboardOption(char *);
 static void Analyze(char *);
 static void StopAnalyze(char *);
 static void SelfPlay(char *);
@@ -90,11 +108,21 @@ static void Conf(char *);
 static void SaveConf(char *);
 static void ShowScore(char *);
 static void TestScore(char *);
+static void ResizeHashTables(char *);
+static void Memory(char *);
+static void HashSave(char *);
+static void HashLoad(char *);
+static void HashStats(char *);
+#if MP
+static void Smp(char *);
+static void SmpBench(char *);
+#endif /* MP */
 
 static struct CommandEntry Commands[] = {
     {"analyze", &Analyze, false, false, "enter analyze mode (xboard)", NULL},
     {"anno", &Anno, false, false, "annotate a game", NULL},
-    {"bench", &Benchmark, false, false, "run a benchmark", NULL},
+    {"bench", &SearchBenchCmd, false, false, "run the search benchmark",
+     NULL},
     {"book", &Book, false, false, "display book moves", NULL},
     {"bk", &Book, false, false, "display book moves (xboard)", NULL},
     {"bookup", &Bookup, false, false, "create a book", NULL},
@@ -113,21 +141,51 @@ static struct CommandEntry Commands[] = {
     {"force", &Force, true, false, "switch force mode (xboard)", NULL},
     {"go", &Go, false, false, "start searching", NULL},
     {"hard", &Hard, true, false, "switch on permanent brain", NULL},
+    {"hashload", &HashLoad, false, false, "load transposition table", NULL},
+    {"hashsave", &HashSave, false, false, "save transposition table", NULL},
+    {"hashstats", &HashStats, false, false, "show hashtable statistics",
+     NULL},
     {"help", &Help, true, false, "show help", NULL},
+    {"ht", &ResizeHashTables, false, false, "resize hashtables", NULL},
     {"level", &SetTime, false, false, "set time control", NULL},
     {"load", &Load, false, false, "load game from PGN file", NULL},
+    {"memory", &Memory, false, false, "set hashtable size in MB (xboard)",
+     NULL},
+    {"movebench", &Benchmark, false, false, "time DoMove/UndoMove", NULL},
     {"moves", &MovesCmd, false, false, "show legal moves", NULL},
+    {"moveoverhead", &SetMoveOverhead, false, false,
+     "set time lost per move in ms", NULL},
+    {"multipv", &MultiPVCmd, true, false, "set number of lines to search",
+     NULL},
     {"name", &Name, true, false, "set the opponents name", NULL},
     {"new", &NewGame, true, true, "start new game", NULL},
+    {"nodes", &SetNodeLimit, false, false, "search a fixed number of nodes",
+     NULL},
     {"nopost", &NoPost, true, false, "switch off post mode (xboard)", NULL},
-    {"perft", &Perft, false, false, "Run the perft benchmark", NULL},
+    {"option", &XboardOption, true, false, "set engine option (xboard)",
+     NULL},
+    {"otim", &XboardOtim, true, false, "set opponent time (xboard)", NULL},
+    {"perft", &PerftCmd, false, false, "count leaf nodes of the move tree",
+     NULL},
+    {"perfthash", &PerftHash, false, false, "set perft hashtable size",
+     NULL},
     {"post", &Post, true, false, "switch on post mode (xboard)", NULL},
+#if HAVE_FORK
+    {"ptest", &ParallelTest, false, false,
+     "run EPD test suite in parallel processes", NULL},
+#endif /* HAVE_FORK */
     {"prefs", &Prefs, false, false, "read opening book preferences", NULL},
     {"quit", &Quit, true, false, "quit Amy", NULL},
     {"s", &ShowScore, true, false, "display static evaluation", NULL},
     {"save", &Save, false, false, "save game to PGN file", NULL},
+    {"sd", &SetDepthLimit, false, false, "search to a fixed depth", NULL},
     {"self", &SelfPlay, false, false, "start self play", NULL},
     {"show", &Show, true, false, "display current position", NULL},
+#if MP
+    {"smp", &Smp, false, false, "select parallel search algorithm", NULL},
+    {"smpbench", &SmpBench, false, false,
+     "compare parallel search algorithms", NULL},
+#endif /* MP */
     {"test", &Test, false, false, "run EPD test suite", NULL},
     {"test-score", &TestScore, false, false,
      "run static evaluatior on EPD test suite", NULL},
@@ -217,15 +275,118 @@ static void ShowEco(char *args) {
     Print(0, "Eco code is %s\n", eco);
 }
 
+/**
+ * Check whether 'move' solves the last position read by
+ * CreatePositionFromEPD().
+ */
+static bool IsTestSolution(int move) {
+    bool correct = false;
+    int j;
+
+    for (j = 0; goodmove[j] != M_NONE; j++)
+        if (move == goodmove[j])
+            correct = true;
+
+    if (!correct && badmove[0] != M_NONE) {
+        correct = true;
+
+        for (j = 0; badmove[j] != M_NONE; j++)
+            if (move == badmove[j])
+                correct = false;
+    }
+
+    return correct;
+}
+
+/**
+ * Read the positions of EPD file 'fname', skipping empty lines and
+ * comments. Returns a malloc()ed array and sets 'npos', or returns NULL if
+ * the file cannot be read.
+ */
+static char (*ReadEPDFile(const char *fname, int *npos))[256] {
+    char(*lines)[256] = NULL;
+    char line[256];
+    FILE *fin = fopen(fname, "r");
+
+    *npos = 0;
+    if (!fin) {
+        Print(0, "Couldn't open %s for input.\n", fname);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), fin)) {
+        if (line[0] == '\n' || line[0] == '#')
+            continue;
+        char(*tmp)[256] = realloc(lines, (*npos + 1) * sizeof(*lines));
+        if (tmp == NULL)
+            break;
+        lines = tmp;
+        strcpy(lines[(*npos)++], line);
+    }
+    fclose(fin);
+
+    return lines;
+}
+
+/*
+ * The running score of a test suite: positions solved and the data for the
+ * BT2630, LCT2 and BS2830 ratings.
+ */
+struct TestSuiteScore {
+    int solved;
+    int total;
+    int btav;
+    int lctval;
+};
+
+static void InitTestScore(struct TestSuiteScore *score) {
+    score->solved = score->total = score->btav = 0;
+    score->lctval = 1900;
+}
+
+/**
+ * Add a position to the score. 'fhtime' is the time in seconds at which
+ * the solution was found.
+ */
+static void AddTestResult(struct TestSuiteScore *score, bool correct,
+                          unsigned int fhtime) {
+    score->total++;
+    if (correct) {
+        score->solved++;
+
+        score->btav += (fhtime < 900) ? fhtime : 900;
+
+        if (fhtime < 10)
+            score->lctval += 30;
+        else if (fhtime < 30)
+            score->lctval += 25;
+        else if (fhtime < 90)
+            score->lctval += 20;
+        else if (fhtime < 180)
+            score->lctval += 15;
+        else if (fhtime < 390)
+            score->lctval += 10;
+        else if (fhtime <= 600)
+            score->lctval += 5;
+    } else {
+        score->btav += 900;
+    }
+}
+
+static void PrintTestScore(const struct TestSuiteScore *score) {
+    int btval = 2630 - (score->btav / score->total);
+    int bsval = (score->btav / (17 * 60));
+    bsval = 2830 - bsval * bsval;
+
+    Print(0, "solved %d out of %d  (BT2630 = %d, LCT2 = %d, BS2830 = %d)\n",
+          score->solved, score->total, btval, score->lctval, bsval);
+}
+
 static void Test(char *fname) {
     struct Position *p;
-    int solved = 0, total = 0;
+    struct TestSuiteScore score;
     FILE *fin, *fout;
     int i;
-    int btav = 0;
-    int btval;
-    int bsval;
-    int lctval = 1900;
     char line[256];
 
     if (!fname) {
@@ -240,10 +401,11 @@ static void Test(char *fname) {
     }
 
     fout = fopen("nsolved.epd", "w");
+    InitTestScore(&score);
 
     for (i = 1;; i++) {
-        int move, j;
-        bool correct = false;
+        int move;
+        bool correct;
 
         if (fgets(line, 256, fin) == NULL)
             break;
@@ -254,50 +416,21 @@ static void Test(char *fname) {
         /* TestSwap(); */
 
         move = Iterate(p);
-        for (j = 0; goodmove[j] != M_NONE; j++)
-            if (move == goodmove[j])
-                correct = true;
-
-        if (!correct && badmove[0] != M_NONE) {
-            correct = true;
-
-            for (j = 0; badmove[j] != M_NONE; j++)
-                if (move == badmove[j])
-                    correct = false;
+        correct = IsTestSolution(move);
+        if (MultiPV > 1) {
+            ShowMultiPV();
         }
 
-        total++;
+        AddTestResult(&score, correct, FHTime);
         if (correct) {
             Print(0, "solved!\n");
-            solved++;
-
-            btav += (FHTime < 900) ? FHTime : 900;
-
-            if (FHTime < 10)
-                lctval += 30;
-            else if (FHTime < 30)
-                lctval += 25;
-            else if (FHTime < 90)
-                lctval += 20;
-            else if (FHTime < 180)
-                lctval += 15;
-            else if (FHTime < 390)
-                lctval += 10;
-            else if (FHTime <= 600)
-                lctval += 5;
         } else {
             Print(0, "not solved!\n");
-            btav += 900;
             if (fout)
                 fprintf(fout, "%s", line);
         }
 
-        btval = 2630 - (btav / total);
-        bsval = (btav / (17 * 60));
-        bsval = 2830 - bsval * bsval;
-
-        Print(0, "solved %d out of %d  (BT2630 = %d, LCT2 = %d, BS2830 = %d)\n",
-              solved, total, btval, lctval, bsval);
+        PrintTestScore(&score);
         Print(0, "-----------------------------------------------\n\n");
 
         FreePosition(p);
@@ -309,6 +442,219 @@ static void Test(char *fname) {
         fclose(fout);
 }
 
+#if HAVE_FORK
+
+/* The result of a test position, sent from a worker to the parent */
+struct TestResult {
+    int index;
+    int move;
+    bool correct;
+    unsigned int fhtime;
+    char san[16]; /* the move found, so the parent needn't parse the EPD */
+};
+
+/*
+ * A worker process of ParallelTest. It searches the positions whose indices
+ * it reads from 'tasks' and writes the results to 'results'. The worker
+ * gets its own 'ht_size' hashtables and searches with a single thread.
+ * Output and input have been detached by the caller right after fork().
+ */
+static void TestWorker(char (*lines)[256], int tasks, int results,
+                       const char *ht_size) {
+    int index;
+
+#if MP
+    ForgetHelpers();
+    NumberOfCPUs = 0;
+#endif /* MP */
+    ResizeHT((char *)ht_size, false);
+
+    while (read(tasks, &index, sizeof(index)) == sizeof(index)) {
+        struct Position *p = CreatePositionFromEPD(lines[index]);
+        struct TestResult result = {.index = index};
+
+        result.move = Iterate(p);
+        result.correct = IsTestSolution(result.move);
+        result.fhtime = FHTime;
+        if (result.move != M_NONE)
+            SAN(p, result.move, result.san);
+        else
+            strcpy(result.san, "-");
+        FreePosition(p);
+
+        if (write(results, &result, sizeof(result)) != sizeof(result))
+            break;
+    }
+}
+
+/*
+ * Run a test suite with several worker processes, each searching one
+ * position at a time with a share of the hashtables. The scores are the
+ * same as those of 'test', taken in file order, and the positions not
+ * solved are written to nsolved.epd.
+ */
+static void ParallelTest(char *args) {
+    char *fname = args ? strtok(args, " \t") : NULL;
+    char *arg = fname ? strtok(NULL, " \t") : NULL;
+    int workers = arg ? atoi(arg) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    char(*lines)[256];
+    struct TestResult *results;
+    struct TestSuiteScore score;
+    int npos, received = 0, started = 0, sent = 0;
+    int tasks[2], done[2];
+    char ht_size[32];
+    unsigned int start;
+    FILE *fout;
+
+    if (fname == NULL || workers < 1) {
+        Print(0, "Usage: ptest <filename> [processes]\n");
+        return;
+    }
+
+    lines = ReadEPDFile(fname, &npos);
+    if (lines == NULL || npos == 0) {
+        free(lines);
+        return;
+    }
+
+    if (workers > npos)
+        workers = npos;
+
+    results = calloc(npos, sizeof(struct TestResult));
+    pid_t *pids = calloc(workers, sizeof(pid_t));
+    if (results == NULL || pids == NULL || pipe(tasks) != 0) {
+        Print(0, "Cannot start worker processes.\n");
+        free(results);
+        free(pids);
+        free(lines);
+        return;
+    }
+    if (pipe(done) != 0) {
+        Print(0, "Cannot start worker processes.\n");
+        close(tasks[0]);
+        close(tasks[1]);
+        free(results);
+        free(pids);
+        free(lines);
+        return;
+    }
+
+    snprintf(ht_size, sizeof(ht_size), "%luk",
+             (unsigned long)(HTTotalSize() / workers) >> 10);
+    Print(0, "Searching %d positions with %d processes, %s hashtables each.\n",
+          npos, workers, ht_size);
+
+    start = GetTime();
+    fflush(stdout);
+
+    for (int w = 0; w < workers; w++) {
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            /* workers neither print nor log nor read input */
+            Verbosity = 0;
+            CloseLogFile();
+            DetachInput();
+            close(tasks[1]);
+            close(done[0]);
+            TestWorker(lines, tasks[0], done[1], ht_size);
+            _exit(0);
+        }
+        if (pid < 0)
+            break;
+        pids[started++] = pid;
+    }
+
+    close(tasks[0]);
+    close(done[1]);
+
+    if (started == 0) {
+        Print(0, "Cannot start worker processes.\n");
+        close(tasks[1]);
+        close(done[0]);
+        free(results);
+        free(pids);
+        free(lines);
+        return;
+    }
+
+    /*
+     * Hand out one task per worker, then the next one for every result
+     * received, so neither pipe ever holds more than one entry per worker
+     * and large suites cannot fill them up. Workers which died must not take
+     * the parent down with SIGPIPE.
+     */
+    void (*sigpipe)(int) = signal(SIGPIPE, SIG_IGN);
+    while (sent < started && sent < npos) {
+        if (write(tasks[1], &sent, sizeof(sent)) != sizeof(sent)) {
+            close(tasks[1]);
+            tasks[1] = -1;
+            break;
+        }
+        sent++;
+    }
+
+    while (received < npos) {
+        struct TestResult result;
+
+        if (read(done[0], &result, sizeof(result)) != sizeof(result))
+            break;
+
+        results[result.index] = result;
+        received++;
+
+        if (tasks[1] >= 0) {
+            if (sent < npos &&
+                write(tasks[1], &sent, sizeof(sent)) == sizeof(sent)) {
+                sent++;
+            } else {
+                close(tasks[1]);
+                tasks[1] = -1;
+            }
+        }
+
+        Print(0, "Problem %d: %s %s\n", result.index + 1, result.san,
+              result.correct ? "solved!" : "not solved!");
+    }
+    if (tasks[1] >= 0)
+        close(tasks[1]);
+    close(done[0]);
+    signal(SIGPIPE, sigpipe);
+
+    for (int w = 0; w < started; w++) {
+        waitpid(pids[w], NULL, 0);
+    }
+
+    if (received < npos) {
+        Print(0, "%d positions were not searched.\n", npos - received);
+    }
+
+    fout = fopen("nsolved.epd", "w");
+    InitTestScore(&score);
+    for (int i = 0; i < npos; i++) {
+        AddTestResult(&score, results[i].correct, results[i].fhtime);
+        if (!results[i].correct && fout)
+            fprintf(fout, "%s", lines[i]);
+    }
+    if (fout)
+        fclose(fout);
+
+    char time_buffer[16];
+    unsigned int elapsed = GetTime() - start;
+
+    Print(0, "-----------------------------------------------\n");
+    PrintTestScore(&score);
+    Print(0, "%d positions in %s, %.1f positions/min\n", npos,
+          FormatTime(elapsed, time_buffer, sizeof(time_buffer)),
+          (elapsed > 0) ? 60.0 * ONE_SECOND * received / elapsed : 0.0);
+
+    free(results);
+    free(pids);
+    free(lines);
+}
+
+#endif /* HAVE_FORK */
+
 static void TestScore(char *fname) {
     struct Position *p;
     FILE *fin, *fout;
@@ -375,6 +721,9 @@ static void SetXBoard(char *args) {
     Print(0, "feature myname=\"Amy " VERSION "\"\n");
     Print(0, "feature san=1\n");
     Print(0, "feature name=1\n");
+    Print(0, "feature memory=1\n");
+    Print(0, "feature option=\"MultiPV -spin %d 1 %d\"\n", MultiPV,
+          MAX_MULTI_PV);
     Print(0, "feature done=1\n");
 
     /* Set up signal handler fuer Ctrl+C */
@@ -429,7 +778,7 @@ void Edit(char *args) {
     while (editing) {
         int sq;
 
-        if (!ReadLine(buffer, 256))
+        if (!ReadLine(buffer, sizeof(buffer)))
             break;
 
         sq = (buffer[1] - 'a') + 8 * (buffer[2] - '1');
@@ -678,64 +1027,183 @@ static void Benchmark(char *args) {
 
     end = GetTime();
 
-    elapsed = (end - start) / 100.0;
+    elapsed = (double)(end - start) / ONE_SECOND;
 
     Print(0, "Nf3: %.2g secs, %g moves/sec\n", elapsed, cycles / elapsed);
 
     FreePosition(p);
 }
 
-static BitBoard SearchFully(struct Position *p, BitBoard cnt, int depth,
-                            heap_t heap) {
-    unsigned int i;
+/*
+ * The positions searched by the search benchmark: opening, middlegame,
+ * tactics and endgames.
+ */
+static const char *const BenchPositions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - -",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - -",
+    "r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - -",
+    "r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq -",
+    "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - -",
+    "1r3k2/4q3/2Pp3b/3Bp3/2Q2p2/1p1P2P1/1P2KP2/3N4 w - -",
+    "2r3k1/pppR1pp1/4p3/4P1P1/5P2/1P4K1/P1P5/8 w - -",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/8 b - -",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - -",
+    NULL};
 
-    if (depth <= 0) {
-        return cnt + 1;
+/*
+ * Search all benchmark positions to 'depth' plies with 'threads' threads,
+ * starting with empty hashtables for each position. Returns the total
+ * number of nodes and the time taken in 'elapsed'.
+ */
+static unsigned long RunSearchBench(int depth, int threads,
+                                    unsigned int *elapsed) {
+    const int verbosity = Verbosity;
+    unsigned long total = 0;
+
+#if MP
+    const int cpus = NumberOfCPUs;
+    NumberOfCPUs = threads;
+#else
+    (void)threads;
+#endif /* MP */
+
+    *elapsed = 0;
+    IgnoreInput(true);
+    for (int i = 0; BenchPositions[i] != NULL; i++) {
+        char line[256];
+        char san_buffer[16];
+        unsigned long nodes;
+
+        strcpy(line, BenchPositions[i]);
+        struct Position *p = CreatePositionFromEPD(line);
+
+        ClearHashTable();
+        ClearPawnHashTable();
+
+        Verbosity = 1;
+        unsigned int start = GetTime();
+        int move = SearchToDepth(p, depth, &nodes);
+        *elapsed += GetTime() - start;
+        Verbosity = verbosity;
+
+        Print(2, "%2d: %-8s %12lu nodes\n", i + 1,
+              SAN(p, move, san_buffer), nodes);
+        total += nodes;
+
+        FreePosition(p);
     }
+    IgnoreInput(false);
 
-    push_section(heap);
-    PLegalMoves(p, heap);
+#if MP
+    NumberOfCPUs = cpus;
+#endif /* MP */
 
-    for (i = heap->current_section->start; i < heap->current_section->end;
-         i++) {
-        int move = heap->data[i];
-        if (move & M_CANY && !MayCastle(p, move))
-            continue;
+    return total;
+}
 
-        DoMove(p, move);
-        if (!InCheck(p, OPP(p->turn))) {
-            cnt = SearchFully(p, cnt, depth - 1, heap);
-        }
-        UndoMove(p, move);
+/**
+ * The search benchmark: search a fixed set of positions to 'depth' plies
+ * with a single thread and, in parallel builds, with 'threads' threads.
+ * The node count of the single threaded run is a signature of the search.
+ */
+void SearchBench(int depth, int threads) {
+    unsigned long nodes[2];
+    unsigned int elapsed[2];
+    int nthreads[2] = {1, threads};
+    int runs = 1;
+
+#if MP
+    if (threads > 1)
+        runs = 2;
+#endif /* MP */
+
+    for (int r = 0; r < runs; r++) {
+        Print(1, "Depth %d, %d thread%s:\n", depth, nthreads[r],
+              (nthreads[r] > 1) ? "s" : "");
+        nodes[r] = RunSearchBench(depth, nthreads[r], elapsed + r);
     }
-    pop_section(heap);
 
-    return cnt;
+    Print(0, "\nThreads         Nodes      Time    Nodes/s\n");
+    for (int r = 0; r < runs; r++) {
+        char time_buffer[16];
+        double secs = (double)elapsed[r] / ONE_SECOND;
+
+        Print(0, "%7d  %12lu  %8s  %9.0f\n", nthreads[r], nodes[r],
+              FormatTime(elapsed[r], time_buffer, sizeof(time_buffer)),
+              (secs > 0.0) ? nodes[r] / secs : 0.0);
+    }
+    Print(0, "Signature: %lu\n", nodes[0]);
 }
 
-static void Perft(char *args) {
-    if (args == NULL) {
-        Print(0, "Usage: perft <depth>\n");
+static void SearchBenchCmd(char *args) {
+    char *arg = args ? strtok(args, " \t") : NULL;
+    int depth = BENCH_DEPTH;
+    int threads = 1;
+
+#if MP
+    threads = NumberOfCPUs;
+#endif /* MP */
+
+    if (arg) {
+        depth = atoi(arg);
+        if ((arg = strtok(NULL, " \t")))
+            threads = atoi(arg);
+    }
+
+    if (depth < 1 || depth > MAX_TREE_SIZE - 2) {
+        Print(0, "Usage: bench [depth [threads]]\n");
         return;
     }
 
-    int depth;
-    sscanf(args, "%d", &depth);
+    SearchBench(depth, threads);
+}
+
+static void PerftCmd(char *args) {
+    char *arg = args ? strtok(args, " \t") : NULL;
+    bool divide = false;
+    int threads = 1;
+
+    if (arg == NULL || atoi(arg) < 0) {
+        Print(0, "Usage: perft <depth> [divide]\n");
+        return;
+    }
+
+    int depth = atoi(arg);
+    while ((arg = strtok(NULL, " \t")) != NULL) {
+        if (!strcmp(arg, "divide"))
+            divide = true;
+    }
+
+#if MP
+    if (NumberOfCPUs > 1)
+        threads = NumberOfCPUs;
+#endif /* MP */
 
-    BitBoard cnt = 0;
-    heap_t heap = allocate_heap();
+    unsigned int start = GetTime();
+    uint64_t cnt = Perft(CurrentPosition, depth, threads, divide);
+    unsigned int end = GetTime();
 
-    int start = GetTime();
-    cnt = SearchFully(CurrentPosition, cnt, depth, heap);
-    int end = GetTime();
+    double elapsed = (double)(end - start) / ONE_SECOND;
+    double nps = (elapsed > 0.0) ? cnt / elapsed : 0.0;
 
-    free_heap(heap);
+    Print(0, "Perft(%d): %llu terminal positions in %g secs (%g nps)\n", depth,
+          (unsigned long long)cnt, elapsed, nps);
+}
+
+static void PerftHash(char *args) {
+    char buffer[16];
 
-    double elapsed = (end - start) / 100.0;
-    double nps = cnt / elapsed;
+    if (args != NULL)
+        SetPerftHashSize(args);
 
-    Print(0, "Perft(%d): %lld terminal positions in %g secs (%g nps)\n", depth,
-          cnt, elapsed, nps);
+    if (PerftHashSize() > 0)
+        Print(0, "Perft hashtable is %s bytes.\n",
+              FormatCount(PerftHashSize(), buffer, sizeof(buffer)));
+    else
+        Print(0, "No perft hashtable.\n");
 }
 
 static void Load(char *args) {
@@ -774,14 +1242,96 @@ static void Flatten(char *args) {
 
 static void XboardTime(char *args) {
     if (args != NULL) {
-        int seconds = atoi(args) / 100;
-
         /*
-         * xboard sends time for the side not to move.
+         * xboard sends time for the side not to move, in centiseconds.
          */
 
-        Time[ComputerSide] = seconds;
+        Time[ComputerSide] = atoi(args) * (ONE_SECOND / 100);
+    }
+}
+
+static void XboardOtim(char *args) {
+    if (args != NULL) {
+        Time[OPP(ComputerSide)] = atoi(args) * (ONE_SECOND / 100);
+    }
+}
+
+static void SetMoveOverhead(char *args) {
+    if (args == NULL) {
+        Print(0, "Move overhead is %d ms.\n", MoveOverhead);
+        return;
+    }
+
+    MoveOverhead = atoi(args);
+    if (MoveOverhead < 0) {
+        MoveOverhead = 0;
+    }
+}
+
+/*
+ * Set the number of principal variations to search. A running analysis is
+ * restarted to pick up the new value.
+ */
+static void SetMultiPV(int lines) {
+    if (lines < 1 || lines > MAX_MULTI_PV) {
+        Print(0, "The number of lines must be between 1 and %d.\n",
+              MAX_MULTI_PV);
+        return;
+    }
+
+    MultiPV = lines;
+    if (State == STATE_ANALYZING) {
+        AbortSearch = true;
+    }
+}
+
+static void MultiPVCmd(char *args) {
+    if (args == NULL) {
+        Print(0, "Searching %d line%s.\n", MultiPV, (MultiPV > 1) ? "s" : "");
+        return;
+    }
+
+    SetMultiPV(atoi(args));
+}
+
+static void XboardOption(char *args) {
+    if (args != NULL && !strncmp(args, "MultiPV=", 8)) {
+        SetMultiPV(atoi(args + 8));
+    }
+}
+
+static void SetDepthLimit(char *args) {
+    if (args == NULL) {
+        if (DepthLimit > 0)
+            Print(0, "Depth limit is %d.\n", DepthLimit);
+        else
+            Print(0, "No depth limit.\n");
+        return;
     }
+
+    int depth = atoi(args);
+    if (depth < 0 || depth > MAX_TREE_SIZE - 2) {
+        Print(0, "Usage: sd <depth>   (0 ... %d, 0 = no limit)\n",
+              MAX_TREE_SIZE - 2);
+        return;
+    }
+
+    DepthLimit = depth;
+}
+
+static void SetNodeLimit(char *args) {
+    if (args == NULL) {
+        char buffer[16];
+
+        if (NodeLimit > 0)
+            Print(0, "Node limit is %s.\n",
+                  FormatCount(NodeLimit, buffer, sizeof(buffer)));
+        else
+            Print(0, "No node limit.\n");
+        return;
+    }
+
+    NodeLimit = strtoul(args, NULL, 10);
 }
 
 static void Analyze(char *args) {
@@ -831,6 +1381,206 @@ static void SaveConf(char *args) {
     SaveEvaluationConfig(args);
 }
 
+static void ResizeHashTables(char *args) {
+    char *size = args ? strtok(args, " \t") : NULL;
+    char *option = size ? strtok(NULL, " \t") : NULL;
+
+    if (size == NULL) {
+        Print(0, "Usage: ht <size> [clear]\n");
+        return;
+    }
+
+    ResizeHT(size, !(option && !strcmp(option, "clear")));
+}
+
+static void Memory(char *args) {
+    char size[32];
+
+    if (args == NULL) {
+        Print(0, "Usage: memory <megabytes>\n");
+        return;
+    }
+
+    snprintf(size, sizeof(size), "%sm", args);
+    ResizeHT(size, true);
+}
+
+static void HashSave(char *args) {
+    if (args == NULL) {
+        Print(0, "Usage: hashsave <filename>\n");
+        return;
+    }
+
+    SaveHT(args);
+}
+
+static void HashLoad(char *args) {
+    if (args == NULL) {
+        Print(0, "Usage: hashload <filename>\n");
+        return;
+    }
+
+    LoadHT(args);
+}
+
+static void HashStats(char *args) {
+    if (args == NULL) {
+        ShowHTDepthStatistics(0);
+        return;
+    }
+
+    if (WriteHTStatistics(args)) {
+        Print(0, "Appended hashtable statistics to %s.\n", args);
+    }
+}
+
+#if MP
+
+static void Smp(char *args) {
+    char *name = args ? strtok(args, " \t") : NULL;
+
+    if (name == NULL) {
+        Print(0, "Parallel search algorithm is %s.\n",
+              ParallelModeName(ParallelMode));
+        return;
+    }
+
+    if (!ParseParallelMode(name, &ParallelMode)) {
+        Print(0, "Usage: smp [abdada|lazy]\n");
+    }
+}
+
+#define SMPBENCH_MAX_CONFIGS 32
+
+/*
+ * Search all positions of an EPD file with both parallel search algorithms
+ * at 2, 4, 8... threads, using the current time control. Reports the
+ * positions solved per minute and the average time to complete iteration
+ * 'depth' over the positions where every run completed it.
+ */
+static void SmpBench(char *args) {
+    char *fname = args ? strtok(args, " \t") : NULL;
+    char *arg;
+    int depth = 10, max_threads = 64;
+    char(*lines)[256] = NULL;
+    int npos = 0;
+    struct {
+        smp_mode_t mode;
+        int threads;
+        int solved;
+        unsigned int elapsed;
+        int *depth_time;
+    } runs[SMPBENCH_MAX_CONFIGS];
+    int nruns = 0;
+    const int cpus = NumberOfCPUs;
+    const smp_mode_t mode = ParallelMode;
+
+    if (fname && (arg = strtok(NULL, " \t")))
+        depth = atoi(arg);
+    if (fname && (arg = strtok(NULL, " \t")))
+        max_threads = atoi(arg);
+
+    if (fname == NULL || depth < 1 || depth >= MAX_TREE_SIZE ||
+        max_threads < 2) {
+        Print(0, "Usage: smpbench <filename> [depth [threads]]\n");
+        return;
+    }
+
+    lines = ReadEPDFile(fname, &npos);
+    if (lines == NULL)
+        return;
+
+    for (int m = SMP_ABDADA; m <= SMP_LAZY; m++) {
+        for (int threads = 2; nruns < SMPBENCH_MAX_CONFIGS;) {
+            runs[nruns].mode = (smp_mode_t)m;
+            runs[nruns].threads = threads;
+            runs[nruns].solved = 0;
+            runs[nruns].elapsed = 0;
+            runs[nruns].depth_time = calloc(npos, sizeof(int));
+            nruns++;
+
+            if (threads >= max_threads)
+                break;
+            threads = (2 * threads < max_threads) ? 2 * threads : max_threads;
+        }
+    }
+
+    for (int r = 0; r < nruns; r++) {
+        NumberOfCPUs = runs[r].threads;
+        ParallelMode = runs[r].mode;
+
+        for (int i = 0; i < npos; i++) {
+            struct Position *p = CreatePositionFromEPD(lines[i]);
+
+            Print(0, "%s, %d threads, problem %d:\n",
+                  ParallelModeName(ParallelMode), NumberOfCPUs, i + 1);
+
+            ClearHashTable();
+            ClearPawnHashTable();
+
+            unsigned int start = GetTime();
+            int move = Iterate(p);
+            runs[r].elapsed += GetTime() - start;
+
+            if (IsTestSolution(move))
+                runs[r].solved++;
+            if (runs[r].depth_time)
+                runs[r].depth_time[i] = SearchDepthTime(depth);
+
+            FreePosition(p);
+        }
+    }
+
+    NumberOfCPUs = cpus;
+    ParallelMode = mode;
+
+    int common = 0;
+    for (int i = 0; i < npos; i++) {
+        bool all = true;
+        for (int r = 0; r < nruns; r++) {
+            if (!runs[r].depth_time || runs[r].depth_time[i] < 0)
+                all = false;
+        }
+        if (all) {
+            common++;
+        } else {
+            for (int r = 0; r < nruns; r++) {
+                if (runs[r].depth_time)
+                    runs[r].depth_time[i] = -1;
+            }
+        }
+    }
+
+    Print(0, "\nAlgorithm Threads  Solved  Solved/min  Time to depth %d\n",
+          depth);
+    for (int r = 0; r < nruns; r++) {
+        double minutes = runs[r].elapsed / (60.0 * ONE_SECOND);
+        double ttd = 0.0;
+
+        for (int i = 0; i < npos; i++) {
+            if (runs[r].depth_time && runs[r].depth_time[i] >= 0)
+                ttd += runs[r].depth_time[i];
+        }
+
+        Print(0, "%-9s %7d  %6d  %10.1f  ", ParallelModeName(runs[r].mode),
+              runs[r].threads, runs[r].solved,
+              minutes > 0.0 ? runs[r].solved / minutes : 0.0);
+        if (common > 0) {
+            Print(0, "%.2f secs\n", ttd / common / ONE_SECOND);
+        } else {
+            Print(0, "-\n");
+        }
+
+        free(runs[r].depth_time);
+    }
+    Print(0, "Time to depth averaged over %d of %d positions.\n", common,
+          npos);
+
+    free(lines);
+}
+
+#endif /* MP */
+
 static void ShowScore(char *args) {
     (void)args;
     InitEvaluation(CurrentPosition);
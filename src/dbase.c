@@ -297,6 +297,18 @@ static void LooseAttacks(struct Position *p, Square to) {
  */
 static inline bool is_sliding(Piece tp) { return tp >= Bishop && tp <= Queen; }
 
+/*
+ * The material key of a position is the sum of the MaterialKey() of all
+ * pieces except the kings. Bishops on dark squares have a key of their
+ * own, so the material key also tells which bishops a side has.
+ */
+static inline hash_t MaterialKey(int color, Piece tp, int sq) {
+    if (tp == Bishop && TstBit(BlackSquaresMask, sq))
+        return MaterialKeys[color][0];
+
+    return MaterialKeys[color][tp];
+}
+
 /*
  * Make a castle move
  * I separated this routine from the normal DoMove routine since it has
@@ -419,6 +431,7 @@ void DoMove(struct Position *p, move_t move) {
     p->actLog->gl_Castle = p->castle;
     p->actLog->gl_HashKey = p->hkey;
     p->actLog->gl_PawnKey = p->pkey;
+    p->actLog->gl_MaterialKey = p->mkey;
 
     if (move & M_CANY) {
         DoCastle(p, move);
@@ -482,6 +495,7 @@ void DoMove(struct Position *p, move_t move) {
             p->hkey ^= HashKeys[OPP(p->turn)][sp][to];
             if (sp == Pawn)
                 p->pkey ^= HashKeys[OPP(p->turn)][Pawn][to];
+            p->mkey -= MaterialKey(OPP(p->turn), sp, to);
             if (to == (OPP(p->turn) == White ? h1 : h8)) {
                 p->castle &= ~(CastleMask[OPP(p->turn)][0]);
             }
@@ -517,6 +531,7 @@ void DoMove(struct Position *p, move_t move) {
             /* update hashkey */
             p->hkey ^= HashKeys[OPP(p->turn)][Pawn][so];
             p->pkey ^= HashKeys[OPP(p->turn)][Pawn][so];
+            p->mkey -= MaterialKey(OPP(p->turn), Pawn, so);
 
             /* re-calculate attacks through to-square */
             LooseAttacks(p, to);
@@ -537,6 +552,9 @@ void DoMove(struct Position *p, move_t move) {
                 p->material_signature[p->turn] &= ~SIGNATURE_BIT(Pawn);
             }
             p->material_signature[p->turn] |= SIGNATURE_BIT(tp);
+
+            p->mkey += MaterialKey(p->turn, tp, to) -
+                       MaterialKey(p->turn, Pawn, to);
         }
 
         /* put it on the board again */
@@ -723,6 +741,7 @@ void UndoMove(struct Position *p, move_t move) {
 
     p->hkey = p->actLog->gl_HashKey;
     p->pkey = p->actLog->gl_PawnKey;
+    p->mkey = p->actLog->gl_MaterialKey;
 
     /*
     DebugEngine(move);
@@ -801,7 +820,7 @@ void RecalcAttacks(struct Position *p) {
 
     p->material[White] = p->material[Black] = p->nonPawn[White] =
         p->nonPawn[Black] = p->material_signature[White] =
-            p->material_signature[Black] = p->hkey = p->pkey = 0;
+            p->material_signature[Black] = p->hkey = p->pkey = p->mkey = 0;
 
     tmp = p->mask[White][0];
     while (tmp) {
@@ -821,6 +840,7 @@ void RecalcAttacks(struct Position *p) {
 
         if (pc != King) {
             p->material_signature[White] |= SIGNATURE_BIT(pc);
+            p->mkey += MaterialKey(White, pc, i);
         }
     }
 
@@ -842,6 +862,7 @@ void RecalcAttacks(struct Position *p) {
 
         if (pc != King) {
             p->material_signature[Black] |= SIGNATURE_BIT(pc);
+            p->mkey += MaterialKey(Black, pc, i);
         }
     }
 
@@ -74,6 +74,12 @@ enum {
     QueensPawnOpening = (1 << 6)
 };
 
+/**
+ * Some constants for material
+ */
+
+enum { OppositeColoredBishops = (1 << 0) };
+
 /**
  * Some constants for RootGamePhase
  */
@@ -688,17 +694,77 @@ static int EvaluatePawnsHashed(const struct Position *p,
                                struct PawnFacts *pawnFacts) {
     int score;
 
-    PTry++;
+    ThreadStats->ss_PTry++;
     if (ProbePT(p->pkey, &score, pawnFacts) != Useful) {
         score = EvaluatePawns(p, pawnFacts);
         StorePT(p->pkey, score, pawnFacts);
     } else {
-        PHit++;
+        ThreadStats->ss_PHit++;
     }
 
     return score;
 }
 
+/**
+ * Evaluate the terms which depend on the material only: bishop pairs, the
+ * game phase and whether both sides have single opposite colored bishops.
+ */
+
+static void EvaluateMaterial(const struct Position *p,
+                             struct MaterialFacts *materialFacts) {
+    BitBoard wb = p->mask[White][Bishop];
+    BitBoard bb = p->mask[Black][Bishop];
+
+    materialFacts->mf_Score = 0;
+    materialFacts->mf_Flags = 0;
+
+    if ((wb & WhiteSquaresMask) && (wb & BlackSquaresMask)) {
+        materialFacts->mf_Score += BishopPair[CountBits(p->mask[White][Pawn])];
+    }
+    if ((bb & WhiteSquaresMask) && (bb & BlackSquaresMask)) {
+        materialFacts->mf_Score -= BishopPair[CountBits(p->mask[Black][Pawn])];
+    }
+
+    materialFacts->mf_WhitePhase = MIN(31, p->nonPawn[Black] / Value[Pawn]);
+    materialFacts->mf_BlackPhase = MIN(31, p->nonPawn[White] / Value[Pawn]);
+
+    /*
+     * Check if both sides have only one bishops. If so, and they are
+     * opposite colored, the score will be scaled down.
+     */
+
+    if (((p->material_signature[White] & 0x1e) == SIGNATURE_BIT(Bishop)) &&
+        ((p->material_signature[Black] & 0x1e) == SIGNATURE_BIT(Bishop))) {
+        bool white_on_white = (wb & WhiteSquaresMask) != 0ULL;
+        bool white_on_black = (wb & BlackSquaresMask) != 0ULL;
+        bool black_on_white = (bb & WhiteSquaresMask) != 0ULL;
+        bool black_on_black = (bb & BlackSquaresMask) != 0ULL;
+
+        bool white_single_colored = white_on_white ^ white_on_black;
+        bool black_single_colored = black_on_white ^ black_on_black;
+
+        if (white_single_colored && black_single_colored) {
+            if ((white_on_white && black_on_black) ||
+                (white_on_black && black_on_white)) {
+                materialFacts->mf_Flags |= OppositeColoredBishops;
+            }
+        }
+    }
+}
+
+/**
+ * Look up the current material in the material hashtable. If not present,
+ * use EvaluateMaterial() and store the result in the material hashtable.
+ */
+
+static void EvaluateMaterialHashed(const struct Position *p,
+                                   struct MaterialFacts *materialFacts) {
+    if (ProbeMT(p->mkey, materialFacts) != Useful) {
+        EvaluateMaterial(p, materialFacts);
+        StoreMT(p->mkey, materialFacts);
+    }
+}
+
 /**
  * Evaluate passed pawns
  */
@@ -1264,15 +1330,16 @@ static int EvaluatePositionForWhite(const struct Position *p) {
     BitBoard pcs;
     BitBoard tmpboard;
     struct PawnFacts pawnFacts;
+    struct MaterialFacts materialFacts;
 
     /*
      * Lookup the current position in the evaluation hashtable
      */
 
 #ifndef DEBUG
-    STry++;
+    ThreadStats->ss_STry++;
     if (ProbeST(p->hkey, &score) == Useful) {
-        SHit++;
+        ThreadStats->ss_SHit++;
         return score;
     }
 #endif
@@ -1280,6 +1347,9 @@ static int EvaluatePositionForWhite(const struct Position *p) {
     score = MaterialBalance(p);
     fastscore = score;
 
+    EvaluateMaterialHashed(p, &materialFacts);
+    score += materialFacts.mf_Score;
+
 #ifdef DEBUG
     if (DebugWhat & DebugPieces) {
         Print(0, "After material balance: %d\n", score);
@@ -1300,8 +1370,8 @@ static int EvaluatePositionForWhite(const struct Position *p) {
      *
      *************************************************************/
 
-    wphase = MIN(31, p->nonPawn[Black] / Value[Pawn]);
-    bphase = MIN(31, p->nonPawn[White] / Value[Pawn]);
+    wphase = materialFacts.mf_WhitePhase;
+    bphase = materialFacts.mf_BlackPhase;
 
     score += EvaluateKingSafety(p, wphase, bphase, &pawnFacts);
 
@@ -1519,11 +1589,6 @@ static int EvaluatePositionForWhite(const struct Position *p) {
      */
 
     pcs = p->mask[White][Bishop];
-
-    if ((pcs & WhiteSquaresMask) && (pcs & BlackSquaresMask)) {
-        score += BishopPair[CountBits(p->mask[White][Pawn])];
-    }
-
     while (pcs) {
         sq = FindSetBit(pcs);
         pcs &= pcs - 1;
@@ -1543,11 +1608,6 @@ static int EvaluatePositionForWhite(const struct Position *p) {
      */
 
     pcs = p->mask[Black][Bishop];
-
-    if ((pcs & WhiteSquaresMask) && (pcs & BlackSquaresMask)) {
-        score -= BishopPair[CountBits(p->mask[Black][Pawn])];
-    }
-
     while (pcs) {
         sq = FindSetBit(pcs);
         pcs &= pcs - 1;
@@ -1702,30 +1762,12 @@ static int EvaluatePositionForWhite(const struct Position *p) {
 #endif
 
     /*
-     * Check if both sides have only one bishops. If so, and they are opposite
-     * colored, scale the score down.
+     * Scale the score down if both sides have single opposite colored
+     * bishops.
      */
 
-    if (((p->material_signature[White] & 0x1e) == SIGNATURE_BIT(Bishop)) &&
-        ((p->material_signature[Black] & 0x1e) == SIGNATURE_BIT(Bishop))) {
-        bool white_on_white =
-            (p->mask[White][Bishop] & WhiteSquaresMask) != 0ULL;
-        bool white_on_black =
-            (p->mask[White][Bishop] & BlackSquaresMask) != 0ULL;
-        bool black_on_white =
-            (p->mask[Black][Bishop] & WhiteSquaresMask) != 0ULL;
-        bool black_on_black =
-            (p->mask[Black][Bishop] & BlackSquaresMask) != 0ULL;
-
-        bool white_single_colored = white_on_white ^ white_on_black;
-        bool black_single_colored = black_on_white ^ black_on_black;
-
-        if (white_single_colored && black_single_colored) {
-            if ((white_on_white && black_on_black) ||
-                (white_on_black && black_on_white)) {
-                score = 4 * score / 5;
-            }
-        }
+    if (materialFacts.mf_Flags & OppositeColoredBishops) {
+        score = 4 * score / 5;
     }
 
 #ifdef DEBUG
@@ -0,0 +1,340 @@
+/*
+
+    Amy - a chess playing program
+
+    Copyright (c) 2002-2025, Thorsten Greiner
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/*
+ * hashmem.c - memory management for the hash tables
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "hashmem.h"
+#include "search.h"
+
+#if HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#if MP && HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+ * Try to back large hash tables with huge pages. Can be switched off by
+ * 'hugepages=false' in .amyrc.
+ */
+bool UseHugePages = true;
+
+/*
+ * Clear the hash tables from all search threads, so the pages of the tables
+ * are distributed across the NUMA nodes the threads run on. Can be switched
+ * off by 'numa=false' in .amyrc.
+ */
+bool UseParallelFirstTouch = true;
+
+static const char *HashBackingNames[] = {
+    "none",       "heap",         "regular pages", "transparent huge pages",
+    "huge pages", "file mapping"};
+
+static size_t RoundUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+
+static void *MapAnonymous(size_t size, int flags) {
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+/**
+ * Allocate 'size' bytes with mmap. Explicit huge pages are tried first,
+ * then regular pages advised to be backed by transparent huge pages.
+ */
+static void *AllocateMappedMemory(struct HashMemory *hm, size_t size) {
+    size_t rounded = RoundUp(size, HUGE_PAGE_SIZE);
+    void *mem;
+
+#ifdef MAP_HUGETLB
+    mem = MapAnonymous(rounded, MAP_HUGETLB);
+    if (mem != NULL) {
+        hm->hm_Base = mem;
+        hm->hm_Size = rounded;
+        hm->hm_Backing = HB_HUGE_PAGES;
+        return mem;
+    }
+#endif /* MAP_HUGETLB */
+
+    /*
+     * Transparent huge pages are only used for huge page aligned ranges,
+     * so map an extra huge page to align the start of the table.
+     */
+    mem = MapAnonymous(rounded + HUGE_PAGE_SIZE, 0);
+    if (mem == NULL) {
+        return NULL;
+    }
+
+    hm->hm_Base = mem;
+    hm->hm_Size = rounded + HUGE_PAGE_SIZE;
+    hm->hm_Backing = HB_PAGES;
+
+    void *aligned = (void *)RoundUp((uintptr_t)mem, HUGE_PAGE_SIZE);
+
+#if HAVE_MADVISE && defined(MADV_HUGEPAGE)
+    if (madvise(aligned, rounded, MADV_HUGEPAGE) == 0) {
+        hm->hm_Backing = HB_TRANSPARENT_HUGE_PAGES;
+    }
+#endif /* HAVE_MADVISE && MADV_HUGEPAGE */
+
+    return aligned;
+}
+
+#endif /* HAVE_MMAP && MAP_ANONYMOUS */
+
+/**
+ * Allocate 'size' bytes of cache line aligned memory for a hash table.
+ * The memory is not necessarily cleared, use ClearHashMemory() for that.
+ */
+void *AllocateHashMemory(struct HashMemory *hm, size_t size) {
+    hm->hm_Base = NULL;
+    hm->hm_Size = 0;
+    hm->hm_Backing = HB_NONE;
+
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+    if (UseHugePages && size >= HUGE_PAGE_SIZE) {
+        void *mem = AllocateMappedMemory(hm, size);
+        if (mem != NULL) {
+            return mem;
+        }
+    }
+#endif /* HAVE_MMAP && MAP_ANONYMOUS */
+
+    void *mem = malloc(size + CACHE_LINE_SIZE);
+    if (mem == NULL) {
+        return NULL;
+    }
+
+    hm->hm_Base = mem;
+    hm->hm_Size = size + CACHE_LINE_SIZE;
+    hm->hm_Backing = HB_HEAP;
+
+    return (void *)RoundUp((uintptr_t)mem, CACHE_LINE_SIZE);
+}
+
+/**
+ * Map 'size' bytes of the file 'fd' starting at 'offset' (a multiple of the
+ * page size) copy-on-write into memory. Returns NULL if the file cannot be
+ * mapped.
+ */
+void *MapHashFile(struct HashMemory *hm, int fd, size_t offset, size_t size) {
+    hm->hm_Base = NULL;
+    hm->hm_Size = 0;
+    hm->hm_Backing = HB_NONE;
+
+#if HAVE_MMAP
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                     (off_t)offset);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+
+    hm->hm_Base = mem;
+    hm->hm_Size = size;
+    hm->hm_Backing = HB_FILE;
+
+    return mem;
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+
+    return NULL;
+#endif /* HAVE_MMAP */
+}
+
+void FreeHashMemory(struct HashMemory *hm) {
+    switch (hm->hm_Backing) {
+    case HB_NONE:
+        break;
+    case HB_HEAP:
+        free(hm->hm_Base);
+        break;
+    default:
+#if HAVE_MMAP
+        munmap(hm->hm_Base, hm->hm_Size);
+#endif
+        break;
+    }
+
+    hm->hm_Base = NULL;
+    hm->hm_Size = 0;
+    hm->hm_Backing = HB_NONE;
+}
+
+#if MP && HAVE_LIBPTHREAD
+
+struct HashJobSlice {
+    HashJob hs_Job;
+    void *hs_Arg;
+    int hs_Slice;
+    uint64_t hs_Start;
+    uint64_t hs_End;
+};
+
+static void *RunHashJobSlice(void *arg) {
+    struct HashJobSlice *slice = arg;
+    slice->hs_Job(slice->hs_Arg, slice->hs_Slice, slice->hs_Start,
+                  slice->hs_End);
+    return NULL;
+}
+
+static void RunHelperSlice(void *slices, int slice) {
+    RunHashJobSlice((struct HashJobSlice *)slices + slice);
+}
+
+#endif /* MP && HAVE_LIBPTHREAD */
+
+/**
+ * Number of slices RunHashJob() splits work into, i.e. the number of
+ * threads it uses.
+ */
+int HashJobSlices(void) {
+#if MP && HAVE_LIBPTHREAD
+    return NumberOfCPUs > 1 ? NumberOfCPUs : 1;
+#else
+    return 1;
+#endif
+}
+
+/**
+ * Run 'job' on the range [0, count) split into at most 'nslices' slices
+ * (see HashJobSlices()) whose boundaries are multiples of 'granularity'.
+ * In MP builds each slice runs on its own thread: on the search helper
+ * threads, so the pages are first touched by the threads that search, or
+ * on threads started for the job while the helpers are busy searching.
+ * 'job' gets the number of its slice, so it can keep partial results per
+ * slice.
+ */
+void RunHashJob(HashJob job, void *arg, uint64_t count, uint64_t granularity,
+                int nslices) {
+    uint64_t chunk = RoundUp((count + nslices - 1) / nslices, granularity);
+
+    if (nslices <= 1 || chunk >= count) {
+        job(arg, 0, 0, count);
+        return;
+    }
+
+#if MP && HAVE_LIBPTHREAD
+    pthread_t *tids = calloc(nslices, sizeof(pthread_t));
+    bool *started = calloc(nslices, sizeof(bool));
+    struct HashJobSlice *slices = calloc(nslices, sizeof(struct HashJobSlice));
+
+    if (tids && started && slices) {
+        for (int i = 0; i < nslices; i++) {
+            uint64_t start = i * chunk < count ? i * chunk : count;
+            uint64_t end = start + chunk < count ? start + chunk : count;
+
+            slices[i] = (struct HashJobSlice){.hs_Job = job,
+                                              .hs_Arg = arg,
+                                              .hs_Slice = i,
+                                              .hs_Start = start,
+                                              .hs_End = end};
+        }
+
+        if (RunOnHelpers(RunHelperSlice, slices, nslices)) {
+            free(tids);
+            free(started);
+            free(slices);
+            return;
+        }
+
+        for (int i = 1; i < nslices; i++) {
+            started[i] = pthread_create(tids + i, NULL, RunHashJobSlice,
+                                        slices + i) == 0;
+            if (!started[i]) {
+                RunHashJobSlice(slices + i);
+            }
+        }
+
+        RunHashJobSlice(slices);
+
+        for (int i = 1; i < nslices; i++) {
+            if (started[i]) {
+                pthread_join(tids[i], NULL);
+            }
+        }
+
+        free(tids);
+        free(started);
+        free(slices);
+        return;
+    }
+
+    free(tids);
+    free(started);
+    free(slices);
+#endif /* MP && HAVE_LIBPTHREAD */
+
+    for (int i = 0; i < nslices; i++) {
+        uint64_t start = i * chunk < count ? i * chunk : count;
+        uint64_t end = start + chunk < count ? start + chunk : count;
+        job(arg, i, start, end);
+    }
+}
+
+static void ClearHashMemoryJob(void *mem, int slice, uint64_t start,
+                               uint64_t end) {
+    (void)slice;
+    memset((char *)mem + start, 0, end - start);
+}
+
+/**
+ * Clear 'size' bytes of hash table memory. Large tables are split into
+ * huge page sized chunks which are cleared by all threads (unless
+ * UseParallelFirstTouch is false), so every page is first touched by one
+ * of them.
+ */
+void ClearHashMemory(void *mem, size_t size) {
+    int nslices = UseParallelFirstTouch ? HashJobSlices() : 1;
+
+    RunHashJob(ClearHashMemoryJob, mem, size, HUGE_PAGE_SIZE, nslices);
+}
+
+const char *HashBackingName(enum HashBacking backing) {
+    return HashBackingNames[backing];
+}
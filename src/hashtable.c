@@ -33,45 +33,176 @@
  * hashtable.c - hashtable management routines
  */
 
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "amy.h"
+#include "hashmem.h"
 #include "hashtable.h"
 #include "random.h"
 #include "search.h"
 #include "utils.h"
 
+#if HAVE_MMAP
+#include <sys/stat.h>
+#endif
+
 #define HT_AGE (0x3f)
-#define HT_NCPU ((0x3f) << 6)
-#define HT_NCPU_INCREMENT (1 << 6)
 #define HT_THREAT (1 << 12)
+#define HT_BOUND (3 << 13)
 #define HT_EXACT (1 << 13)
-#define HT_LBOUND (1 << 14)
-#define HT_UBOUND (1 << 15)
+#define HT_LBOUND (2 << 13)
+#define HT_UBOUND (3 << 13)
+
+/*
+ * Layout of the data word of a transposition table entry:
+ *
+ *   bits  0..19  best move (bit 12 of a move_t is unused and squeezed out)
+ *   bits 20..38  score (two's complement)
+ *   bits 39..48  depth (saturated at HT_MAX_DEPTH)
+ *   bits 49..63  flags (HT_AGE, HT_THREAT and HT_BOUND)
+ */
+#define HT_SCORE_SHIFT 20
+#define HT_SCORE_BITS 19
+#define HT_DEPTH_SHIFT 39
+#define HT_MAX_DEPTH 0x3ff
+#define HT_FLAGS_SHIFT 49
 
-#define PT_INVALID 0xffff
+/* Minimum depth (two plies) of entries kept when resizing the table. */
+#define MIGRATE_MIN_DEPTH (2 * 16)
+
+/* Seed of the random numbers used for the Zobrist keys. */
+#define ZOBRIST_SEED 0
+
+/*
+ * A transposition table file starts with a header padded to
+ * HT_FILE_HEADER_SIZE bytes, followed by the buckets of the table. The
+ * padding keeps the buckets page aligned (for page sizes up to 64k) so
+ * they can be mapped directly.
+ * HT_FILE_VERSION must be increased when the entry layout changes.
+ */
+#define HT_FILE_MAGIC "AmyHash"
+#define HT_FILE_VERSION 1
+#define HT_FILE_HEADER_SIZE 65536
+
+struct HTFileHeader {
+    char hf_Magic[8];
+    uint32_t hf_Version;
+    uint32_t hf_BucketSize;
+    uint64_t hf_Buckets;
+    uint64_t hf_ZobristSeed;
+    uint64_t hf_ZobristFingerprint;
+    uint32_t hf_Generation;
+};
+
+/*
+ * In a MP build the transposition table is accessed without locks by
+ * default. Torn entries are detected by the XOR'ed key, see struct HTEntry.
+ * Compile with -DLOCKLESS_HASHING=0 to use the reader/writer locks instead.
+ */
+#ifndef LOCKLESS_HASHING
+#define LOCKLESS_HASHING 1
+#endif
 
 hash_t HashKeys[2][8][64];
 hash_t HashKeysEP[64];
 hash_t HashKeysCastle[16];
 hash_t STMKey;
+hash_t MaterialKeys[2][8];
+
+/*
+ * The transposition table can have any number of buckets. The pawn and
+ * score tables are a power of two in size with at most 2^32 entries. They
+ * are indexed by the lower bits of the key, the signature of an entry is
+ * taken from the upper bits.
+ */
+#define MAX_TABLE_BITS 32
 
-static int HT_Bits = 17;
+/*
+ * Layout of a pawn table entry:
+ *
+ *   pt_Key    bits  0..7   white queen side
+ *             bits  8..23  score
+ *             bits 24..63  signature
+ *   pt_White  bits  0..47  white passers (shifted down by 8)
+ *             bits 48..55  flags
+ *             bits 56..63  white king side
+ *   pt_Black  bits  0..47  black passers (shifted down by 8)
+ *             bits 48..55  black king side
+ *             bits 56..63  black queen side
+ *
+ * A score table entry has the score in bits 0..15 and the signature in
+ * bits 16..63.
+ *
+ * A material table entry has the score in bits 0..15, the white and black
+ * phase in bits 16..20 and 21..25, the flags in bits 26..31 and the
+ * signature in bits 32..63. There are few material configurations, so
+ * the material table has a small fixed size.
+ */
+#define PT_SIGNATURE_BITS 40
+#define ST_SIGNATURE_BITS 48
+#define MT_SIGNATURE_BITS 32
+#define MT_BITS 12
+#define MT_SIZE ((uint64_t)1 << MT_BITS)
+#define PASSERS_MASK 0xffffffffffffULL
+
+static uint64_t HT_Size = 1 << 15;
 static int PT_Bits = 15;
 static int ST_Bits = 15;
 
-static unsigned int HT_Size, HT_Mask;
-static unsigned int PT_Size, PT_Mask;
-static unsigned int ST_Size, ST_Mask;
-
-int L_HT_Bits = 16, L_HT_Size, L_HT_Mask;
+static uint64_t PT_Size, PT_Mask;
+static uint64_t ST_Size, ST_Mask;
 
-static struct HTEntry *TranspositionTable = NULL;
+static struct HTBucket *TranspositionTable = NULL;
 static struct PTEntry *PawnTable = NULL;
 static struct STEntry *ScoreTable = NULL;
+static struct MTEntry *MaterialTable = NULL;
+static struct HashMemory TranspositionTableMemory, PawnTableMemory,
+    ScoreTableMemory, MaterialTableMemory;
 static int HTGeneration = 0;
+static unsigned int EvalGeneration = 0;
+
+/*
+ * Transposition table statistics of the last search by remaining depth
+ * in plies, summed up from the search threads by AddHTStatistics(). Deeper
+ * nodes are counted in the last row.
+ */
+static unsigned long HTStats[HT_STATS_DEPTHS][HS_Count];
+static unsigned int HTStatsSearch = 0;
+
+/* Counts of threads which are not searching go here and are never shown. */
+static struct SearchStats IdleStats;
+THREAD_LOCAL struct SearchStats *ThreadStats = &IdleStats;
+
+/* The file the statistics are appended to after each search, if any. */
+static char *HTStatsFile = NULL;
+
+#if MP && HAVE_LIBPTHREAD
 
-static OPTIONAL_ATOMIC unsigned int HTStoreFailed = 0, HTStoreTried = 0;
+/*
+ * Private pawn and score tables of a search thread. If LocalEvalCaches is
+ * set every search thread evaluates through its own EvalCache, which needs
+ * no locking. The shared budget of the pawn and score tables is split
+ * among the threads.
+ */
+struct EvalCache {
+    struct PTEntry *ec_PawnTable;
+    struct STEntry *ec_ScoreTable;
+    uint64_t ec_PawnMask, ec_ScoreMask;
+    struct HashMemory ec_PawnMemory, ec_ScoreMemory;
+};
+
+/* Minimum number of bits of a private pawn or score table. */
+#define EVAL_CACHE_MIN_BITS 10
+
+bool LocalEvalCaches = true;
+static struct EvalCache *EvalCaches = NULL;
+static int EvalCacheCount = 0;
+static _Thread_local struct EvalCache *ThreadEvalCache = NULL;
+
+#endif /* MP && HAVE_LIBPTHREAD */
 
 #if MP && HAVE_LIBPTHREAD
 
@@ -80,7 +211,6 @@ static OPTIONAL_ATOMIC unsigned int HTStoreFailed = 0, HTStoreTried = 0;
 #define MUTEX_MASK (MUTEX_COUNT - 1)
 static atomic_int TranspositionMutex[MUTEX_COUNT];
 static atomic_int PawnMutex[MUTEX_COUNT];
-static atomic_int ScoreMutex[MUTEX_COUNT];
 
 /**
  * Acquire a read lock for the given pointer. There can be many read locks,
@@ -142,250 +272,428 @@ static void release_write_lock(atomic_int *data) {
 
 #endif
 
+static inline uint64_t PackHTData(move_t move, int score, int depth,
+                                  int flags) {
+    uint64_t data = (move & 0xfff) | ((move >> 1) & 0xff000);
+
+    if (depth > HT_MAX_DEPTH) {
+        depth = HT_MAX_DEPTH;
+    }
+
+    data |= (uint64_t)(score & ((1 << HT_SCORE_BITS) - 1)) << HT_SCORE_SHIFT;
+    data |= (uint64_t)depth << HT_DEPTH_SHIFT;
+    data |= (uint64_t)flags << HT_FLAGS_SHIFT;
+
+    return data;
+}
+
+static inline move_t HTMove(uint64_t data) {
+    return (move_t)((data & 0xfff) | ((data & 0xff000) << 1));
+}
+
+static inline int HTScore(uint64_t data) {
+    int score = (data >> HT_SCORE_SHIFT) & ((1 << HT_SCORE_BITS) - 1);
+
+    if (score >= (1 << (HT_SCORE_BITS - 1))) {
+        score -= (1 << HT_SCORE_BITS);
+    }
+
+    return score;
+}
+
+static inline int HTDepth(uint64_t data) {
+    return (data >> HT_DEPTH_SHIFT) & HT_MAX_DEPTH;
+}
+
+static inline int HTFlags(uint64_t data) { return data >> HT_FLAGS_SHIFT; }
+
+static inline uint64_t WithHTFlags(uint64_t data, int flags) {
+    data &= ((uint64_t)1 << HT_FLAGS_SHIFT) - 1;
+    return data | ((uint64_t)flags << HT_FLAGS_SHIFT);
+}
+
 /**
- * Gets an entry from the global transposition table.
+ * Create an entry for 'key' with the XOR'ed key check.
  */
-static inline struct HTEntry GetHTEntry(hash_t key) {
-#if MP && HAVE_LIBPTHREAD
-    atomic_int *mutex = TranspositionMutex + ((key >> 32) & MUTEX_MASK);
+static inline struct HTEntry MakeHTEntry(hash_t key, uint64_t data) {
+    struct HTEntry entry = {.ht_Key = key ^ data, .ht_Data = data};
+    return entry;
+}
+
+/**
+ * Check if an entry belongs to 'key'. This fails for entries which were
+ * read while another thread was writing them.
+ */
+static inline bool HTKeyMatches(struct HTEntry entry, hash_t key) {
+    return (entry.ht_Key ^ entry.ht_Data) == key;
+}
+
+/**
+ * Returns the bucket of the global transposition table for 'key'.
+ */
+static inline struct HTBucket *HTBucketFor(hash_t key) {
+    return TranspositionTable + HashIndex(key, HT_Size);
+}
+
+#if MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING
+static inline atomic_int *HTMutexFor(struct HTBucket *bucket) {
+    return TranspositionMutex + ((bucket - TranspositionTable) & MUTEX_MASK);
+}
+#endif /* MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING */
+
+/**
+ * Gets a copy of a bucket from the global transposition table.
+ */
+static inline struct HTBucket GetHTBucket(struct HTBucket *bucket) {
+#if MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING
+    atomic_int *mutex = HTMutexFor(bucket);
     acquire_read_lock(mutex);
-#endif /* MP && HAVE_LIBPTHREAD */
+#endif /* MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING */
 
-    struct HTEntry entry = TranspositionTable[(key >> 32) & HT_Mask];
+    struct HTBucket copy = *bucket;
 
-#if MP && HAVE_LIBPTHREAD
+#if MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING
     release_read_lock(mutex);
-#endif /* MP && HAVE_LIBPTHREAD */
+#endif /* MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING */
 
-    return entry;
+    return copy;
 }
 
 /**
- * Puts an entry to the global transposition table.
+ * Puts an entry to slot 'slot' of a bucket of the global transposition
+ * table.
  */
-static inline void PutHTEntry(hash_t key, struct HTEntry entry) {
-#if MP && HAVE_LIBPTHREAD
-    atomic_int *mutex = TranspositionMutex + ((key >> 32) & MUTEX_MASK);
+static inline void PutHTEntry(struct HTBucket *bucket, int slot,
+                              struct HTEntry entry) {
+#if MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING
+    atomic_int *mutex = HTMutexFor(bucket);
     acquire_write_lock(mutex);
-#endif /* MP && HAVE_LIBPTHREAD */
+#endif /* MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING */
 
-    TranspositionTable[(key >> 32) & HT_Mask] = entry;
+    bucket->hb_Entries[slot] = entry;
 
-#if MP && HAVE_LIBPTHREAD
+#if MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING
     release_write_lock(mutex);
-#endif /* MP && HAVE_LIBPTHREAD */
+#endif /* MP && HAVE_LIBPTHREAD && !LOCKLESS_HASHING */
 }
 
 /**
- *
+ * Find the entry for 'key' in a bucket. Returns the slot or -1 if there
+ * is no such entry.
  */
-static inline bool PutHTEntryBestEffort(hash_t key, struct HTEntry entry,
-                                        int depth) {
-    const hash_t key1 = key;
-    const hash_t key2 = key + 1;
+static inline int FindHTSlot(const struct HTBucket *bucket, hash_t key) {
+    for (int i = 0; i < HT_BUCKET_SIZE; i++) {
+        if (HTKeyMatches(bucket->hb_Entries[i], key)) {
+            return i;
+        }
+    }
+    return -1;
+}
 
-    struct HTEntry entry1 = GetHTEntry(key1);
-    struct HTEntry entry2 = GetHTEntry(key2);
+static inline bool IsEmptyHTEntry(struct HTEntry entry) {
+    return entry.ht_Key == 0 && entry.ht_Data == 0;
+}
 
-    /* Overwrite any matching entry. */
-    if (entry1.ht_Signature == (unsigned int)key) {
-        PutHTEntry(key1, entry);
-        return true;
-    }
-    if (entry2.ht_Signature == (unsigned int)key) {
-        PutHTEntry(key2, entry);
-        return true;
-    }
+/**
+ * Select the slot of a bucket which is overwritten when storing an entry
+ * for 'key'. In order of preference this is
+ *
+ *  - the entry for the same key,
+ *  - an empty entry,
+ *  - the shallowest entry from an older search,
+ *  - the shallowest entry from the current search.
+ */
+static int SelectHTSlot(const struct HTBucket *bucket, hash_t key) {
+    int victim = 0;
+    int victim_rank = -1;
+    int victim_depth = 0;
 
-    /* Overwrite entries with lower depth. */
-    if (entry1.ht_Depth <= entry2.ht_Depth) {
-        if (entry1.ht_Depth <= depth) {
-            PutHTEntry(key1, entry);
-            return true;
-        }
-        if (entry2.ht_Depth <= depth) {
-            PutHTEntry(key2, entry);
-            return true;
+    for (int i = 0; i < HT_BUCKET_SIZE; i++) {
+        struct HTEntry entry = bucket->hb_Entries[i];
+        int rank;
+
+        if (HTKeyMatches(entry, key)) {
+            return i;
         }
-    } else {
-        if (entry2.ht_Depth <= depth) {
-            PutHTEntry(key2, entry);
-            return true;
+
+        if (IsEmptyHTEntry(entry)) {
+            rank = 2;
+        } else if ((HTFlags(entry.ht_Data) & HT_AGE) != HTGeneration) {
+            rank = 1;
+        } else {
+            rank = 0;
         }
-        if (entry1.ht_Depth <= depth) {
-            PutHTEntry(key1, entry);
-            return true;
+
+        int entry_depth = HTDepth(entry.ht_Data);
+        if (rank > victim_rank ||
+            (rank == victim_rank && entry_depth < victim_depth)) {
+            victim = i;
+            victim_rank = rank;
+            victim_depth = entry_depth;
         }
     }
 
-    /* Overwrite entries from older generation. */
-    if ((entry1.ht_Flags & HT_AGE) != HTGeneration) {
-        PutHTEntry(key1, entry);
-        return true;
-    }
-    if ((entry2.ht_Flags & HT_AGE) != HTGeneration) {
-        PutHTEntry(key2, entry);
-        return true;
+    return victim;
+}
+
+/**
+ * Store an entry to a bucket using the replacement policy of
+ * SelectHTSlot(). 'copy' is the content of the bucket as read before.
+ */
+static inline void PutHTEntryBestEffort(struct HTBucket *bucket,
+                                        const struct HTBucket *copy,
+                                        hash_t key, struct HTEntry entry,
+                                        int depth) {
+    int slot = SelectHTSlot(copy, key);
+    struct HTEntry victim = copy->hb_Entries[slot];
+    if (!IsEmptyHTEntry(victim) && !HTKeyMatches(victim, key)) {
+        CountHT(HS_Replaced, depth);
     }
 
-    return false;
+    PutHTEntry(bucket, slot, entry);
 }
 
-#if MP
 LookupResult ProbeHT(hash_t key, int *score, int depth, move_t *bestm,
-                     bool *threat, int ply, int exclusiveP,
-                     struct HTEntry *localHT)
-#else
-LookupResult ProbeHT(hash_t key, int *score, int depth, move_t *bestm,
-                     bool *threat, int ply)
-#endif
-{
-    hash_t effective_key = key;
-    struct HTEntry h = GetHTEntry(effective_key);
-    bool found = h.ht_Signature == (unsigned int)key;
-
-    if (!found) {
-        effective_key++;
-        h = GetHTEntry(effective_key);
-        found = h.ht_Signature == (unsigned int)key;
+                     bool *threat, int ply) {
+    struct HTBucket *bucket = HTBucketFor(key);
+    struct HTBucket copy = GetHTBucket(bucket);
+    int slot = FindHTSlot(&copy, key);
+
+    if (slot < 0) {
+        *bestm = M_NONE;
+        return Useless;
     }
 
-    int result = Useless;
+    struct HTEntry h = copy.hb_Entries[slot];
+    int flags = HTFlags(h.ht_Data);
 
-#if MP
-    if (localHT != NULL && !found) {
-        h = localHT[(key >> 32) & L_HT_Mask];
-        found = h.ht_Signature == (unsigned int)key;
+    *bestm = HTMove(h.ht_Data);
+    *threat = (flags & HT_THREAT);
+
+    if (HTDepth(h.ht_Data) < depth) {
+        return Useful;
     }
-#endif
 
-    if (found) {
-        *bestm = h.ht_Move;
-        *threat = (h.ht_Flags & HT_THREAT);
+    *score = HTScore(h.ht_Data);
 
-#if MP
-        if ((int)h.ht_Depth == depth && exclusiveP &&
-            (h.ht_Flags & HT_NCPU) > 0) {
+    /*
+     * Correct a mate score. See comment in 'StoreHT'.
+     */
 
-            result = OnEvaluation;
+    if (*score > CMLIMIT) {
+        *score -= ply;
+    } else if (*score < -CMLIMIT) {
+        *score += ply;
+    }
 
-        } else
-#endif
+    switch (flags & HT_BOUND) {
+    case HT_EXACT:
+        return ExactScore;
+    case HT_LBOUND:
+        return LowerBound;
+    case HT_UBOUND:
+        return UpperBound;
+    }
 
-            if ((int)h.ht_Depth >= depth) {
-            *score = h.ht_Score;
+    return Useless;
+}
 
-            /*
-             * Correct a mate score. See comment in 'StoreHT'.
-             */
+#if MP
 
-            if (*score > CMLIMIT) {
-                *score -= ply;
-            } else if (*score < -CMLIMIT) {
-                *score += ply;
-            }
+/*
+ * The ABDADA in-flight table records which nodes are currently searched
+ * by some thread. Each slot is a single atomic word holding the upper bits
+ * of the node's tag and, in the lower IF_COUNT_BITS, the number of threads
+ * searching it. A slot with a count of zero is free. Only nodes currently
+ * on the stack of some thread are in the table, so it can be small.
+ */
+#define IF_BITS 14
+#define IF_SIZE (1 << IF_BITS)
+#define IF_COUNT_BITS 8
+#define IF_COUNT_MASK ((1 << IF_COUNT_BITS) - 1)
 
-            if (h.ht_Flags & HT_EXACT) {
-                result = ExactScore;
-            } else if (h.ht_Flags & HT_LBOUND) {
-                result = LowerBound;
-            } else if (h.ht_Flags & HT_UBOUND) {
-                result = UpperBound;
-            }
+static _Atomic uint64_t InFlightTable[IF_SIZE];
 
-#if MP
-            if ((int)h.ht_Depth == depth) {
+/**
+ * Nodes are keyed by position and remaining depth.
+ */
+static inline uint64_t InFlightTag(hash_t key, int depth) {
+    return (key ^ ((uint64_t)depth * 0x9e3779b97f4a7c15ULL)) & ~IF_COUNT_MASK;
+}
 
-                /*
-                 * increment processor count
-                 */
+static inline _Atomic uint64_t *InFlightSlot(uint64_t tag) {
+    return InFlightTable + ((tag >> 32) & (IF_SIZE - 1));
+}
 
-                h.ht_Flags += HT_NCPU_INCREMENT;
-                PutHTEntry(effective_key, h);
-            }
-#endif /* MP */
+/**
+ * Enter a node into the in-flight table. If 'exclusiveP' is true and
+ * another thread is searching the node, IF_BUSY is returned and the node
+ * is not entered. IF_ENTERED means the node must be left with
+ * LeaveInFlight() later. If the slot is taken by a different node, the
+ * node is not tracked and IF_UNTRACKED is returned.
+ */
+InFlightResult EnterInFlight(hash_t key, int depth, bool exclusiveP) {
+    uint64_t tag = InFlightTag(key, depth);
+    _Atomic uint64_t *slot = InFlightSlot(tag);
+    uint64_t value = atomic_load_explicit(slot, memory_order_relaxed);
 
+    for (;;) {
+        uint64_t count = value & IF_COUNT_MASK;
+        uint64_t next;
+
+        if (count == 0) {
+            next = tag | 1;
+        } else if ((value & ~IF_COUNT_MASK) != tag) {
+            return IF_UNTRACKED;
+        } else if (exclusiveP) {
+            return IF_BUSY;
+        } else if (count == IF_COUNT_MASK) {
+            return IF_UNTRACKED;
         } else {
-            result = Useful;
+            next = value + 1;
+        }
+
+        if (atomic_compare_exchange_weak(slot, &value, next)) {
+            return IF_ENTERED;
         }
     }
-#if MP
-    else {
-        h.ht_Depth = depth;
-        h.ht_Flags = HT_NCPU_INCREMENT;
-        h.ht_Signature = (int)key;
-        PutHTEntryBestEffort(key, h, depth);
-    }
-#endif /* MP */
+}
 
-    return result;
+/**
+ * Leave a node entered by EnterInFlight().
+ */
+void LeaveInFlight(hash_t key, int depth) {
+    _Atomic uint64_t *slot = InFlightSlot(InFlightTag(key, depth));
+    atomic_fetch_sub(slot, 1);
 }
 
-LookupResult ProbePT(hash_t key, int *score, struct PawnFacts *pf) {
+#endif /* MP */
+
+#if HAVE___BUILTIN_PREFETCH
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+/**
+ * Prefetch the transposition table bucket for 'key', so it is already in
+ * the cache when ProbeHT() is called.
+ */
+void PrefetchHT(hash_t key) { PREFETCH(HTBucketFor(key)); }
+
+/**
+ * The pawn table entry for 'key', taken from the private table of the
+ * calling thread if it has one.
+ */
+static inline struct PTEntry *PTEntryFor(hash_t key) {
 #if MP && HAVE_LIBPTHREAD
-    acquire_read_lock(PawnMutex + ((key >> 32) & MUTEX_MASK));
+    struct EvalCache *ec = ThreadEvalCache;
+    if (ec != NULL)
+        return ec->ec_PawnTable + (key & ec->ec_PawnMask);
 #endif /* MP && HAVE_LIBPTHREAD */
 
-    struct PTEntry h = PawnTable[(key >> 32) & PT_Mask];
+    return PawnTable + (key & PT_Mask);
+}
 
+/**
+ * The score table entry for 'key', see PTEntryFor().
+ */
+static inline struct STEntry *STEntryFor(hash_t key) {
 #if MP && HAVE_LIBPTHREAD
-    release_read_lock(PawnMutex + ((key >> 32) & MUTEX_MASK));
+    struct EvalCache *ec = ThreadEvalCache;
+    if (ec != NULL)
+        return ec->ec_ScoreTable + (key & ec->ec_ScoreMask);
 #endif /* MP && HAVE_LIBPTHREAD */
 
-    if (h.pt_Signature == (unsigned int)key && h.pt_Score != PT_INVALID) {
-        *score = h.pt_Score;
-        *pf = h.pt_PawnFacts;
-        return Useful;
-    }
+    return ScoreTable + (key & ST_Mask);
+}
 
-    return Useless;
+/**
+ * Prefetch the pawn table entry for 'key'.
+ */
+void PrefetchPT(hash_t key) { PREFETCH(PTEntryFor(key)); }
+
+/**
+ * Prefetch the score table entry for 'key'.
+ */
+void PrefetchST(hash_t key) { PREFETCH(STEntryFor(key)); }
+
+/**
+ * The 'bits' wide signature of pawn and score table entries. It includes
+ * the current generation, see ClearPawnHashTable().
+ */
+static inline uint64_t EvalSignature(hash_t key, int bits) {
+    return (key ^ (EvalGeneration * 0x9e3779b97f4a7c15ULL)) >> (64 - bits);
 }
 
-LookupResult ProbeST(hash_t key, int *score) {
+LookupResult ProbePT(hash_t key, int *score, struct PawnFacts *pf) {
 #if MP && HAVE_LIBPTHREAD
-    acquire_read_lock(ScoreMutex + ((key >> 32) & MUTEX_MASK));
+    bool shared = ThreadEvalCache == NULL;
+    if (shared)
+        acquire_read_lock(PawnMutex + (key & MUTEX_MASK));
 #endif /* MP && HAVE_LIBPTHREAD */
 
-    struct STEntry h = ScoreTable[(key >> 32) & ST_Mask];
+    struct PTEntry h = *PTEntryFor(key);
 
 #if MP && HAVE_LIBPTHREAD
-    release_read_lock(ScoreMutex + ((key >> 32) & MUTEX_MASK));
+    if (shared)
+        release_read_lock(PawnMutex + (key & MUTEX_MASK));
 #endif /* MP && HAVE_LIBPTHREAD */
 
-    if (h.st_Signature == (unsigned int)key && h.st_Score != PT_INVALID) {
-        *score = h.st_Score;
-        return Useful;
-    }
+    if ((h.pt_Key >> 24) != EvalSignature(key, PT_SIGNATURE_BITS))
+        return Useless;
 
-    return Useless;
+    *score = (int16_t)(h.pt_Key >> 8);
+    pf->pf_WhitePassers = (h.pt_White & PASSERS_MASK) << 8;
+    pf->pf_BlackPassers = (h.pt_Black & PASSERS_MASK) << 8;
+    pf->pf_Flags = (uint8_t)(h.pt_White >> 48);
+    pf->pf_WhiteKingSide = (char)(h.pt_White >> 56);
+    pf->pf_BlackKingSide = (char)(h.pt_Black >> 48);
+    pf->pf_WhiteQueenSide = (char)h.pt_Key;
+    pf->pf_BlackQueenSide = (char)(h.pt_Black >> 56);
+
+    return Useful;
 }
 
-void StoreHT(hash_t key, int best, int alpha, int beta, int bestm, int depth,
-             int threat, int ply
-#if MP
-             ,
-             struct HTEntry *localHT
-#endif
-) {
-    hash_t effective_key = key;
-    struct HTEntry entry = GetHTEntry(effective_key);
-    bool found = entry.ht_Signature == (unsigned int)key;
+/**
+ * The score table needs no locking, its entries are a single word.
+ */
+LookupResult ProbeST(hash_t key, int *score) {
+    uint64_t h = STEntryFor(key)->st_Key;
 
-    if (!found) {
-        effective_key++;
-        entry = GetHTEntry(effective_key);
-        found = entry.ht_Signature == (unsigned int)key;
-    }
+    if ((h >> 16) != EvalSignature(key, ST_SIGNATURE_BITS))
+        return Useless;
 
-    HTStoreTried++;
+    *score = (int16_t)h;
+    return Useful;
+}
 
-#if MP
-    if (!found) {
-        entry = localHT[(key >> 32) & L_HT_Mask];
-    }
-#endif
+/**
+ * The material table needs no locking, its entries are a single word.
+ */
+LookupResult ProbeMT(hash_t key, struct MaterialFacts *mf) {
+    uint64_t h = MaterialTable[key & (MT_SIZE - 1)].mt_Key;
+
+    if ((h >> 32) != EvalSignature(key, MT_SIGNATURE_BITS))
+        return Useless;
+
+    mf->mf_Score = (int16_t)h;
+    mf->mf_WhitePhase = (h >> 16) & 31;
+    mf->mf_BlackPhase = (h >> 21) & 31;
+    mf->mf_Flags = (h >> 26) & 63;
+
+    return Useful;
+}
+
+void StoreHT(hash_t key, int best, int alpha, int beta, int bestm, int depth,
+             int threat, int ply) {
+    struct HTBucket *bucket = HTBucketFor(key);
+    struct HTBucket copy = GetHTBucket(bucket);
+
+    CountHT(HS_Stores, depth);
 
     int reduced = best;
+    int flags = HTGeneration;
 
     /*
      * Handling of mate scores is a bit tricky.
@@ -400,74 +708,79 @@ void StoreHT(hash_t key, int best, int alpha, int beta, int bestm, int depth,
         reduced -= ply;
     }
 
-#if MP
-    if (entry.ht_Signature == (unsigned int)key && depth == entry.ht_Depth) {
-        if ((entry.ht_Flags & HT_NCPU) > 0) {
-            entry.ht_Flags = (entry.ht_Flags & HT_NCPU) - HT_NCPU_INCREMENT;
-        }
-    } else {
-        entry.ht_Signature = (unsigned int)key;
-        entry.ht_Flags = 0;
-    }
-#else
-    entry.ht_Signature = (unsigned int)key;
-#endif /* MP */
-
-    entry.ht_Move = bestm;
-    entry.ht_Depth = depth;
-    entry.ht_Score = reduced;
-#if MP
-    entry.ht_Flags |= HTGeneration;
-#else
-    entry.ht_Flags = HTGeneration;
-#endif /* MP */
     if (best <= alpha)
-        entry.ht_Flags |= HT_UBOUND;
+        flags |= HT_UBOUND;
     else if (best >= beta)
-        entry.ht_Flags |= HT_LBOUND;
+        flags |= HT_LBOUND;
     else
-        entry.ht_Flags |= HT_EXACT;
+        flags |= HT_EXACT;
 
     if (threat)
-        entry.ht_Flags |= HT_THREAT;
+        flags |= HT_THREAT;
 
-    bool success = PutHTEntryBestEffort(key, entry, depth);
-    if (!success) {
-        HTStoreFailed++;
-#if MP
-        localHT[(key >> 32) & L_HT_Mask] = entry;
-#endif
-    }
+    PutHTEntryBestEffort(
+        bucket, &copy, key,
+        MakeHTEntry(key, PackHTData(bestm, reduced, depth, flags)), depth);
 }
 
+/**
+ * Store the pawn structure score and PawnFacts for 'key'. A score which
+ * does not fit into 16 bits is not stored.
+ */
 void StorePT(hash_t key, int score, struct PawnFacts *pf) {
-    struct PTEntry h = {.pt_Signature = (unsigned int)key,
-                        .pt_Score = score,
-                        .pt_PawnFacts = *pf};
+    if (score != (int16_t)score)
+        return;
+
+    struct PTEntry h = {
+        .pt_Key = EvalSignature(key, PT_SIGNATURE_BITS) << 24 |
+                  (uint64_t)(uint16_t)score << 8 |
+                  (uint8_t)pf->pf_WhiteQueenSide,
+        .pt_White = (pf->pf_WhitePassers >> 8) |
+                    (uint64_t)(uint8_t)pf->pf_Flags << 48 |
+                    (uint64_t)(uint8_t)pf->pf_WhiteKingSide << 56,
+        .pt_Black = (pf->pf_BlackPassers >> 8) |
+                    (uint64_t)(uint8_t)pf->pf_BlackKingSide << 48 |
+                    (uint64_t)(uint8_t)pf->pf_BlackQueenSide << 56};
 
 #if MP && HAVE_LIBPTHREAD
-    acquire_write_lock(PawnMutex + ((key >> 32) & MUTEX_MASK));
+    bool shared = ThreadEvalCache == NULL;
+    if (shared)
+        acquire_write_lock(PawnMutex + (key & MUTEX_MASK));
 #endif /* MP && HAVE_LIBPTHREAD */
 
-    PawnTable[(key >> 32) & PT_Mask] = h;
+    *PTEntryFor(key) = h;
 
 #if MP && HAVE_LIBPTHREAD
-    release_write_lock(PawnMutex + ((key >> 32) & MUTEX_MASK));
+    if (shared)
+        release_write_lock(PawnMutex + (key & MUTEX_MASK));
 #endif /* MP && HAVE_LIBPTHREAD */
 }
 
+/**
+ * Store the evaluation 'score' for 'key'. A score which does not fit into
+ * 16 bits is not stored.
+ */
 void StoreST(hash_t key, int score) {
-    struct STEntry h = {.st_Signature = (unsigned int)key, .st_Score = score};
-
-#if MP && HAVE_LIBPTHREAD
-    acquire_write_lock(ScoreMutex + ((key >> 32) & MUTEX_MASK));
-#endif /* MP && HAVE_LIBPTHREAD */
+    if (score != (int16_t)score)
+        return;
 
-    ScoreTable[(key >> 32) & ST_Mask] = h;
+    STEntryFor(key)->st_Key =
+        EvalSignature(key, ST_SIGNATURE_BITS) << 16 | (uint16_t)score;
+}
 
-#if MP && HAVE_LIBPTHREAD
-    release_write_lock(ScoreMutex + ((key >> 32) & MUTEX_MASK));
-#endif /* MP && HAVE_LIBPTHREAD */
+/**
+ * Store the MaterialFacts for the material key 'key'. Facts which do not
+ * fit into an entry are not stored.
+ */
+void StoreMT(hash_t key, const struct MaterialFacts *mf) {
+    if (mf->mf_Score != (int16_t)mf->mf_Score || mf->mf_WhitePhase > 31 ||
+        mf->mf_BlackPhase > 31 || mf->mf_Flags > 63)
+        return;
+
+    MaterialTable[key & (MT_SIZE - 1)].mt_Key =
+        EvalSignature(key, MT_SIGNATURE_BITS) << 32 |
+        (uint64_t)mf->mf_Flags << 26 | (uint64_t)mf->mf_BlackPhase << 21 |
+        (uint64_t)mf->mf_WhitePhase << 16 | (uint16_t)mf->mf_Score;
 }
 
 /* Moved this to a seperate routine to make the PB-Move
@@ -475,54 +788,192 @@ void StoreST(hash_t key, int score) {
  */
 
 void ClearHashTable(void) {
-    unsigned int i;
-    struct HTEntry *h = TranspositionTable;
-
-    for (i = 0; i < HT_Size; i++, h++) {
-        h->ht_Signature = 0;
-        h->ht_Flags = 0;
-    }
+    ClearHashMemory(TranspositionTable, HT_Size * sizeof(struct HTBucket));
 }
 
 void AgeHashTable(void) {
     HTGeneration++;
     HTGeneration &= HT_AGE;
 
-    HTStoreTried = 0;
-    HTStoreFailed = 0;
+    for (int i = 0; i < HT_STATS_DEPTHS; i++) {
+        for (int j = 0; j < HS_Count; j++) {
+            HTStats[i][j] = 0;
+        }
+    }
+    HTStatsSearch++;
 }
 
-void ClearPawnHashTable(void) {
-    unsigned int i;
-    struct PTEntry *ph;
-    struct STEntry *sh;
+/**
+ * Invalidate the pawn and score tables. Entries from before are not
+ * touched, they no longer match because the generation is part of their
+ * signature.
+ */
+void ClearPawnHashTable(void) { EvalGeneration++; }
 
-    ph = PawnTable;
-    for (i = 0; i < PT_Size; i++, ph++) {
-        ph->pt_Score = PT_INVALID;
+#if MP && HAVE_LIBPTHREAD
+static void FreeEvalCaches(void) {
+    for (int i = 0; i < EvalCacheCount; i++) {
+        FreeHashMemory(&EvalCaches[i].ec_PawnMemory);
+        FreeHashMemory(&EvalCaches[i].ec_ScoreMemory);
     }
+    free(EvalCaches);
+    EvalCaches = NULL;
+    EvalCacheCount = 0;
+}
+#endif /* MP && HAVE_LIBPTHREAD */
+
+static void FreeHT(void) {
+    FreeHashMemory(&TranspositionTableMemory);
+    TranspositionTable = NULL;
+
+    FreeHashMemory(&PawnTableMemory);
+    PawnTable = NULL;
+
+    FreeHashMemory(&ScoreTableMemory);
+    ScoreTable = NULL;
+
+    FreeHashMemory(&MaterialTableMemory);
+    MaterialTable = NULL;
+
+#if MP && HAVE_LIBPTHREAD
+    FreeEvalCaches();
+#endif /* MP && HAVE_LIBPTHREAD */
+}
+
+/**
+ * Allocate and clear the memory for a hash table. Exits if the memory
+ * cannot be allocated.
+ */
+static void *AllocateTable(struct HashMemory *hm, size_t size,
+                           const char *name) {
+    void *table = AllocateHashMemory(hm, size);
 
-    sh = ScoreTable;
-    for (i = 0; i < ST_Size; i++, sh++) {
-        sh->st_Score = PT_INVALID;
+    if (table == NULL) {
+        Print(0, "Cannot allocate %s.\n", name);
+        exit(1);
     }
+
+    ClearHashMemory(table, size);
+
+    return table;
 }
 
-static void FreeHT(void) {
-    if (TranspositionTable) {
-        free(TranspositionTable);
-        TranspositionTable = NULL;
+#if MP && HAVE_LIBPTHREAD
+
+/**
+ * The number of search threads, NumberOfCPUs is 0 unless set.
+ */
+static int SearchThreads(void) { return NumberOfCPUs > 1 ? NumberOfCPUs : 1; }
+
+/**
+ * Allocate one private pawn and score table for each search thread.
+ * Together they are about the size of the shared tables.
+ */
+static void AllocateEvalCaches(void) {
+    int split = 0;
+
+    while ((1 << split) < SearchThreads())
+        split++;
+
+    int pt_bits = PT_Bits - split;
+    int st_bits = ST_Bits - split;
+
+    if (pt_bits < EVAL_CACHE_MIN_BITS)
+        pt_bits = EVAL_CACHE_MIN_BITS;
+    if (st_bits < EVAL_CACHE_MIN_BITS)
+        st_bits = EVAL_CACHE_MIN_BITS;
+
+    EvalCaches = calloc(SearchThreads(), sizeof(struct EvalCache));
+    if (EvalCaches == NULL) {
+        Print(0, "Cannot allocate eval caches.\n");
+        exit(1);
+    }
+    EvalCacheCount = SearchThreads();
+
+    for (int i = 0; i < EvalCacheCount; i++) {
+        struct EvalCache *ec = EvalCaches + i;
+
+        ec->ec_PawnMask = ((uint64_t)1 << pt_bits) - 1;
+        ec->ec_PawnTable = AllocateTable(
+            &ec->ec_PawnMemory, (ec->ec_PawnMask + 1) * sizeof(struct PTEntry),
+            "pawn table");
+        ec->ec_ScoreMask = ((uint64_t)1 << st_bits) - 1;
+        ec->ec_ScoreTable = AllocateTable(
+            &ec->ec_ScoreMemory,
+            (ec->ec_ScoreMask + 1) * sizeof(struct STEntry), "score table");
     }
 
-    if (PawnTable) {
-        free(PawnTable);
-        PawnTable = NULL;
+    Print(1, "Eval caches: %d x %llu k, %llu k (%d, %d bits)\n",
+          EvalCacheCount,
+          (unsigned long long)(((uint64_t)1 << pt_bits) *
+                               sizeof(struct PTEntry) / 1024),
+          (unsigned long long)(((uint64_t)1 << st_bits) *
+                               sizeof(struct STEntry) / 1024),
+          pt_bits, st_bits);
+}
+
+/**
+ * The private pawn and score tables for search thread 'thread', or NULL if
+ * the threads share the global tables. Must be called from the master
+ * thread before the helpers are started.
+ */
+struct EvalCache *GetEvalCache(int thread) {
+    if (!LocalEvalCaches) {
+        if (EvalCacheCount > 0)
+            FreeEvalCaches();
+        return NULL;
     }
 
-    if (ScoreTable) {
-        free(ScoreTable);
-        ScoreTable = NULL;
+    if (EvalCacheCount != SearchThreads()) {
+        FreeEvalCaches();
+        AllocateEvalCaches();
     }
+
+    return thread < EvalCacheCount ? EvalCaches + thread : NULL;
+}
+
+/**
+ * Make the calling thread evaluate through 'ec', or through the shared
+ * tables if 'ec' is NULL.
+ */
+void UseEvalCache(struct EvalCache *ec) { ThreadEvalCache = ec; }
+
+#endif /* MP && HAVE_LIBPTHREAD */
+
+static void AllocateTables(void) {
+    TranspositionTable =
+        AllocateTable(&TranspositionTableMemory,
+                      HT_Size * sizeof(struct HTBucket), "transposition table");
+
+    PT_Size = (uint64_t)1 << PT_Bits;
+    PT_Mask = PT_Size - 1;
+
+    PawnTable = AllocateTable(&PawnTableMemory,
+                              PT_Size * sizeof(struct PTEntry), "pawn table");
+
+    ST_Size = (uint64_t)1 << ST_Bits;
+    ST_Mask = ST_Size - 1;
+
+    ScoreTable = AllocateTable(&ScoreTableMemory,
+                               ST_Size * sizeof(struct STEntry), "score table");
+
+    MaterialTable =
+        AllocateTable(&MaterialTableMemory, MT_SIZE * sizeof(struct MTEntry),
+                      "material table");
+
+    Print(0,
+          "Hashtable sizes: %llu k, %llu k, %llu k, %llu k "
+          "(%llu buckets, %d, %d, %d bits)\n",
+          (unsigned long long)(HT_Size * sizeof(struct HTBucket) / 1024),
+          (unsigned long long)(PT_Size * sizeof(struct PTEntry) / 1024),
+          (unsigned long long)(ST_Size * sizeof(struct STEntry) / 1024),
+          (unsigned long long)(MT_SIZE * sizeof(struct MTEntry) / 1024),
+          (unsigned long long)HT_Size, PT_Bits, ST_Bits, MT_BITS);
+    Print(0, "Hashtable memory: %s, %s, %s, %s\n",
+          HashBackingName(TranspositionTableMemory.hm_Backing),
+          HashBackingName(PawnTableMemory.hm_Backing),
+          HashBackingName(ScoreTableMemory.hm_Backing),
+          HashBackingName(MaterialTableMemory.hm_Backing));
 }
 
 void AllocateHT(void) {
@@ -537,109 +988,579 @@ void AllocateHT(void) {
         atexit(FreeHT);
     }
 
-    HT_Size = 1 << HT_Bits;
-    HT_Mask = HT_Size - 1;
+    FreeHT();
+    AllocateTables();
 
-    TranspositionTable = calloc(HT_Size, sizeof(struct HTEntry));
+#if MP && HAVE_LIBPTHREAD
+    for (int i = 0; i < MUTEX_COUNT; i++) {
+        TranspositionMutex[i] = 0;
+        PawnMutex[i] = 0;
+    }
+#endif
+}
 
-    /* Thread-local hash table - only calculate sizes and bits here...*/
-    L_HT_Size = 1 << L_HT_Bits;
-    L_HT_Mask = L_HT_Size - 1;
+/**
+ * Copy the entries of 'old_table' with a depth of at least 'min_depth' to
+ * the current transposition table. Where entries collide the deeper one
+ * wins. Returns the number of entries copied.
+ */
+static uint64_t MigrateHT(const struct HTBucket *old_table, uint64_t old_size,
+                          int min_depth) {
+    uint64_t migrated = 0;
 
-    PT_Size = 1 << PT_Bits;
-    PT_Mask = PT_Size - 1;
+    for (uint64_t i = 0; i < old_size; i++) {
+        for (int j = 0; j < HT_BUCKET_SIZE; j++) {
+            struct HTEntry entry = old_table[i].hb_Entries[j];
+            int depth = HTDepth(entry.ht_Data);
 
-    PawnTable = calloc(PT_Size, sizeof(struct PTEntry));
+            if (IsEmptyHTEntry(entry) || depth < min_depth) {
+                continue;
+            }
 
-    ST_Size = 1 << ST_Bits;
-    ST_Mask = ST_Size - 1;
+            hash_t key = entry.ht_Key ^ entry.ht_Data;
+            struct HTBucket *bucket = HTBucketFor(key);
+            int slot = SelectHTSlot(bucket, key);
+            struct HTEntry victim = bucket->hb_Entries[slot];
 
-    ScoreTable = calloc(ST_Size, sizeof(struct STEntry));
+            if (!IsEmptyHTEntry(victim) && HTDepth(victim.ht_Data) >= depth) {
+                continue;
+            }
+
+            bucket->hb_Entries[slot] = entry;
+            migrated++;
+        }
+    }
 
-    Print(0, "Hashtable sizes: %d k, %d k, %d k (%d, %d, %d bits)\n",
-          ((1 << HT_Bits) * sizeof(struct HTEntry)) / 1024,
-          ((1 << PT_Bits) * sizeof(struct PTEntry)) / 1024,
-          ((1 << ST_Bits) * sizeof(struct STEntry)) / 1024, HT_Bits, PT_Bits,
-          ST_Bits);
+    return migrated;
+}
+
+/**
+ * Resize the hashtables to 'size' (see GuessHTSizes()). Must only be
+ * called between searches. If 'migrate' is true, the deep entries of the
+ * transposition table are kept, otherwise all tables start out empty.
+ */
+void ResizeHT(char *size, bool migrate) {
+    struct HashMemory old_memory = TranspositionTableMemory;
+    struct HTBucket *old_table = TranspositionTable;
+    uint64_t old_size = HT_Size;
 
+    GuessHTSizes(size);
+
+    FreeHashMemory(&PawnTableMemory);
+    FreeHashMemory(&ScoreTableMemory);
+    FreeHashMemory(&MaterialTableMemory);
 #if MP && HAVE_LIBPTHREAD
-    for (int i = 0; i < MUTEX_COUNT; i++) {
-        TranspositionMutex[i] = 0;
-        PawnMutex[i] = 0;
-        ScoreMutex[i] = 0;
+    /* sized from the shared tables, GetEvalCache() reallocates them */
+    if (EvalCacheCount > 0)
+        FreeEvalCaches();
+#endif /* MP && HAVE_LIBPTHREAD */
+    if (!migrate) {
+        FreeHashMemory(&old_memory);
+        old_table = NULL;
+    }
+
+    AllocateTables();
+
+    if (old_table != NULL) {
+        char buf[16];
+        uint64_t migrated = MigrateHT(old_table, old_size, MIGRATE_MIN_DEPTH);
+
+        FreeHashMemory(&old_memory);
+        Print(0, "Kept %s transposition table entries.\n",
+              FormatCount(migrated, buf, sizeof(buf)));
+    }
+
+    ClearPawnHashTable();
+}
+
+/**
+ * A fingerprint of the Zobrist keys. Files saved with different keys
+ * cannot be loaded.
+ */
+static uint64_t ZobristFingerprint(void) {
+    uint64_t fingerprint = STMKey;
+    int i, j, k;
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 8; j++) {
+            for (k = 0; k < 64; k++) {
+                fingerprint = (fingerprint << 7 | fingerprint >> 57) ^
+                              HashKeys[i][j][k];
+            }
+        }
+    }
+
+    for (i = 0; i < 64; i++) {
+        fingerprint = (fingerprint << 7 | fingerprint >> 57) ^ HashKeysEP[i];
+    }
+
+    for (i = 0; i < 16; i++) {
+        fingerprint =
+            (fingerprint << 7 | fingerprint >> 57) ^ HashKeysCastle[i];
+    }
+
+    return fingerprint;
+}
+
+/**
+ * Save the transposition table to file 'name'. Must only be called between
+ * searches. The table is written to a temporary file which then replaces
+ * 'name', so a table mapped from 'name' by LoadHT() stays valid.
+ */
+bool SaveHT(const char *name) {
+    struct HTFileHeader hf = {.hf_Version = HT_FILE_VERSION,
+                              .hf_BucketSize = sizeof(struct HTBucket),
+                              .hf_Buckets = HT_Size,
+                              .hf_ZobristSeed = ZOBRIST_SEED,
+                              .hf_ZobristFingerprint = ZobristFingerprint(),
+                              .hf_Generation = HTGeneration};
+    char tmpname[FILENAME_MAX];
+    FILE *fout = NULL;
+
+    if (snprintf(tmpname, sizeof(tmpname), "%s.tmp", name) <
+        (int)sizeof(tmpname)) {
+        fout = fopen(tmpname, "wb");
+    }
+
+    if (fout == NULL) {
+        Print(0, "Cannot open %s for writing.\n", name);
+        return false;
+    }
+
+    strncpy(hf.hf_Magic, HT_FILE_MAGIC, sizeof(hf.hf_Magic));
+
+    bool success =
+        fwrite(&hf, sizeof(hf), 1, fout) == 1 &&
+        fseek(fout, HT_FILE_HEADER_SIZE, SEEK_SET) == 0 &&
+        fwrite(TranspositionTable, sizeof(struct HTBucket), HT_Size, fout) ==
+            HT_Size;
+
+    if (fclose(fout) != 0) {
+        success = false;
+    }
+
+    if (success && rename(tmpname, name) != 0) {
+        success = false;
+    }
+
+    if (!success) {
+        Print(0, "Error writing %s.\n", name);
+        remove(tmpname);
+        return false;
+    }
+
+    char buf[16];
+    Print(0, "Saved %s transposition table buckets to %s.\n",
+          FormatCount(HT_Size, buf, sizeof(buf)), name);
+
+    return true;
+}
+
+/**
+ * Read the buckets of a table of a different size from 'fin' and copy
+ * their entries to the transposition table.
+ */
+static bool ReadAndMigrateHT(FILE *fin, uint64_t buckets) {
+    const uint64_t chunk_size = 4096;
+    struct HTBucket *chunk = malloc(chunk_size * sizeof(struct HTBucket));
+    uint64_t migrated = 0;
+
+    if (chunk == NULL) {
+        return false;
+    }
+
+    ClearHashTable();
+
+    for (uint64_t i = 0; i < buckets; i += chunk_size) {
+        uint64_t n = buckets - i < chunk_size ? buckets - i : chunk_size;
+
+        if (fread(chunk, sizeof(struct HTBucket), n, fin) != n) {
+            free(chunk);
+            return false;
+        }
+
+        migrated += MigrateHT(chunk, n, 0);
+    }
+
+    free(chunk);
+
+    char buf[16];
+    Print(0, "Loaded %s transposition table entries.\n",
+          FormatCount(migrated, buf, sizeof(buf)));
+
+    return true;
+}
+
+/**
+ * Load the transposition table from file 'name'. If the table in the file
+ * has the same size as the current one, the file is mapped into memory
+ * instead of read. Must only be called between searches.
+ */
+bool LoadHT(const char *name) {
+    struct HTFileHeader hf;
+    FILE *fin = fopen(name, "rb");
+
+    if (fin == NULL) {
+        Print(0, "Cannot open %s.\n", name);
+        return false;
+    }
+
+    if (fread(&hf, sizeof(hf), 1, fin) != 1 ||
+        fseek(fin, HT_FILE_HEADER_SIZE, SEEK_SET) != 0) {
+        Print(0, "%s is not a hashtable file.\n", name);
+        fclose(fin);
+        return false;
+    }
+
+    if (strncmp(hf.hf_Magic, HT_FILE_MAGIC, sizeof(hf.hf_Magic)) ||
+        hf.hf_Version != HT_FILE_VERSION ||
+        hf.hf_BucketSize != sizeof(struct HTBucket)) {
+        Print(0, "%s is not a hashtable file of this version of Amy.\n",
+              name);
+        fclose(fin);
+        return false;
+    }
+
+    if (hf.hf_ZobristSeed != ZOBRIST_SEED ||
+        hf.hf_ZobristFingerprint != ZobristFingerprint()) {
+        Print(0, "%s was saved with different hash keys.\n", name);
+        fclose(fin);
+        return false;
+    }
+
+    bool success = false;
+
+    if (hf.hf_Buckets == HT_Size) {
+#if HAVE_MMAP
+        size_t size = HT_Size * sizeof(struct HTBucket);
+        struct stat st;
+        struct HashMemory hm;
+        void *table = NULL;
+
+        /* Accessing a mapping beyond the end of the file is fatal. */
+        if (fstat(fileno(fin), &st) == 0 &&
+            (uint64_t)st.st_size >= HT_FILE_HEADER_SIZE + size) {
+            table = MapHashFile(&hm, fileno(fin), HT_FILE_HEADER_SIZE, size);
+        }
+
+        if (table != NULL) {
+            FreeHashMemory(&TranspositionTableMemory);
+            TranspositionTableMemory = hm;
+            TranspositionTable = table;
+            success = true;
+        }
+#endif /* HAVE_MMAP */
+
+        if (!success) {
+            success = fread(TranspositionTable, sizeof(struct HTBucket),
+                            HT_Size, fin) == HT_Size;
+        }
+
+        if (success) {
+            Print(0, "Loaded transposition table (%s).\n",
+                  HashBackingName(TranspositionTableMemory.hm_Backing));
+        }
+    } else {
+        success = ReadAndMigrateHT(fin, hf.hf_Buckets);
+    }
+
+    fclose(fin);
+
+    if (!success) {
+        Print(0, "Error reading %s.\n", name);
+        ClearHashTable();
+        return false;
+    }
+
+    HTGeneration = hf.hf_Generation & HT_AGE;
+
+    return true;
+}
+
+/**
+ * Count the buckets of [start, end) by the number of entries of the
+ * current search they contain.
+ */
+static void CountHTFillJob(void *arg, int slice, uint64_t start,
+                           uint64_t end) {
+    uint64_t *fill = (uint64_t *)arg + slice * (HT_BUCKET_SIZE + 1);
+
+    for (uint64_t i = start; i < end; i++) {
+        const struct HTBucket *b = TranspositionTable + i;
+        int used = 0;
+
+        for (int j = 0; j < HT_BUCKET_SIZE; j++) {
+            if ((HTFlags(b->hb_Entries[j].ht_Data) & HT_AGE) == HTGeneration)
+                used++;
+        }
+        fill[used]++;
     }
-#endif
 }
 
 void ShowHashStatistics(void) {
-    unsigned int i;
-    unsigned int cnt = 0;
-    struct HTEntry *h = TranspositionTable;
+    uint64_t cnt = 0;
+    uint64_t fill[HT_BUCKET_SIZE + 1] = {0};
+    int nslices = HashJobSlices();
+    uint64_t *slice_fill = calloc(nslices * (HT_BUCKET_SIZE + 1),
+                                  sizeof(uint64_t));
+
+    if (slice_fill == NULL) {
+        return;
+    }
+
+    RunHashJob(CountHTFillJob, slice_fill, HT_Size, 1, nslices);
 
-    for (i = 0; i < HT_Size; i++, h++) {
-        if ((h->ht_Flags & HT_AGE) == HTGeneration)
-            cnt++;
+    for (int i = 0; i < nslices; i++) {
+        for (int j = 0; j <= HT_BUCKET_SIZE; j++) {
+            fill[j] += slice_fill[i * (HT_BUCKET_SIZE + 1) + j];
+            cnt += j * slice_fill[i * (HT_BUCKET_SIZE + 1) + j];
+        }
     }
 
+    free(slice_fill);
+
     char buf1[16], buf2[16];
+    uint64_t entries = HT_Size * HT_BUCKET_SIZE;
+    unsigned long stores = 0, replaced = 0;
+
+    for (int i = 0; i < HT_STATS_DEPTHS; i++) {
+        stores += HTStats[i][HS_Stores];
+        replaced += HTStats[i][HS_Replaced];
+    }
+
+    char counts[64], percents[64];
+    int clen = 0, plen = 0;
+
+    for (int j = 0; j <= HT_BUCKET_SIZE && clen < (int)sizeof(counts) &&
+                    plen < (int)sizeof(percents);
+         j++) {
+        const char *sep = (j > 0) ? "/" : "";
+
+        clen += snprintf(counts + clen, sizeof(counts) - clen, "%s%d", sep,
+                         j);
+        plen += snprintf(percents + plen, sizeof(percents) - plen, "%s%d",
+                         sep, Percentage(fill[j], HT_Size));
+    }
 
     Print(1, "Hashtable 1:  entries = %s, use = %s (%d %%)\n",
-          FormatCount(i, buf1, sizeof(buf1)),
-          FormatCount(cnt, buf2, sizeof(buf2)), Percentage(cnt, i));
-    Print(1, "              store failed = %s (%d %%)\n",
-          FormatCount(HTStoreFailed, buf1, sizeof(buf1)),
-          Percentage(HTStoreFailed, HTStoreTried));
+          FormatCount(entries, buf1, sizeof(buf1)),
+          FormatCount(cnt, buf2, sizeof(buf2)), Percentage(cnt, entries));
+    Print(1, "              bucket fill %s = %s %%\n", counts, percents);
+    Print(1, "              stores = %s, replaced = %s (%d %%)\n",
+          FormatCount(stores, buf1, sizeof(buf1)),
+          FormatCount(replaced, buf2, sizeof(buf2)),
+          Percentage(replaced, stores));
+
+    ShowHTDepthStatistics(3);
+
+    if (HTStatsFile != NULL) {
+        WriteHTStatistics(HTStatsFile);
+    }
 }
 
-void GuessHTSizes(char *size) {
-    int last = strlen(size) - 1;
-    int64_t total_size;
-    int64_t tmp;
-
-    if (size[last] == 'k') {
-        total_size = atoi(size) * 1024L;
-    } else if (size[last] == 'm') {
-        total_size = atoi(size) * 1024L * 1024L;
-    } else {
-        total_size = atoi(size) * 1024;
+/**
+ * Let the calling thread count its statistics in 'stats', or nowhere if
+ * 'stats' is NULL.
+ */
+void UseSearchStats(struct SearchStats *stats) {
+    ThreadStats = (stats != NULL) ? stats : &IdleStats;
+}
+
+/**
+ * Add the statistics 'add' to 'sum'.
+ */
+void AddSearchStats(struct SearchStats *sum, const struct SearchStats *add) {
+    unsigned long *s = (unsigned long *)sum;
+    const unsigned long *a = (const unsigned long *)add;
+
+    for (size_t i = 0; i < sizeof(struct SearchStats) / sizeof(*s); i++) {
+        s[i] += a[i];
     }
+}
 
-    if (total_size < 64 * 1024) {
-        Print(0, "I need at least 64k of hashtables.\n");
-        total_size = 64 * 1024;
+/**
+ * Add the transposition table statistics of a search thread to those of
+ * the last search.
+ */
+void AddHTStatistics(const struct SearchStats *stats) {
+    for (int i = 0; i < HT_STATS_DEPTHS; i++) {
+        for (int j = 0; j < HS_Count; j++) {
+            HTStats[i][j] += stats->ss_HT[i][j];
+        }
     }
+}
 
-    tmp = total_size * 4 / 5;
+/**
+ * Count a transposition table event at remaining depth 'depth' (in 1/16
+ * plies).
+ */
+void CountHT(HTStat stat, int depth) {
+    int row = depth / 16;
 
-    for (HT_Bits = 1; HT_Bits < 32; HT_Bits++) {
-        long tmp2 = (1 << (HT_Bits + 1)) * sizeof(struct HTEntry);
-        if (tmp2 > tmp)
-            break;
+    if (row < 0) {
+        row = 0;
+    } else if (row >= HT_STATS_DEPTHS) {
+        row = HT_STATS_DEPTHS - 1;
     }
 
-    total_size -= (1 << HT_Bits) * sizeof(struct HTEntry);
+    ThreadStats->ss_HT[row][stat]++;
+}
 
-    tmp = 3 * total_size / 4;
+/**
+ * Print the transposition table statistics of the last search by
+ * remaining depth. Rows without probes or stores are left out. Useless
+ * hits found the position but could not cut off.
+ */
+void ShowHTDepthStatistics(int vb) {
+    char buf[9][16];
 
-    for (ST_Bits = 1; ST_Bits < 32; ST_Bits++) {
-        long tmp2 = (1 << (ST_Bits + 1)) * sizeof(struct STEntry);
-        if (tmp2 > tmp)
-            break;
+    Print(vb, "depth   probes     hits    exact    lower    upper  useless"
+              "   stores replaced  illegal\n");
+
+    for (int i = 0; i < HT_STATS_DEPTHS; i++) {
+        const unsigned long *s = HTStats[i];
+        unsigned long cutoffs =
+            s[HS_ExactCutoffs] + s[HS_LowerCutoffs] + s[HS_UpperCutoffs];
+
+        if (s[HS_Probes] == 0 && s[HS_Stores] == 0) {
+            continue;
+        }
+
+        Print(vb, "%3d%s %8s %8s %8s %8s %8s %8s %8s %8s %8s\n", i,
+              i == HT_STATS_DEPTHS - 1 ? "+" : " ",
+              FormatCount(s[HS_Probes], buf[0], sizeof(buf[0])),
+              FormatCount(s[HS_Hits], buf[1], sizeof(buf[1])),
+              FormatCount(s[HS_ExactCutoffs], buf[2], sizeof(buf[2])),
+              FormatCount(s[HS_LowerCutoffs], buf[3], sizeof(buf[3])),
+              FormatCount(s[HS_UpperCutoffs], buf[4], sizeof(buf[4])),
+              FormatCount(s[HS_Hits] - cutoffs, buf[5], sizeof(buf[5])),
+              FormatCount(s[HS_Stores], buf[6], sizeof(buf[6])),
+              FormatCount(s[HS_Replaced], buf[7], sizeof(buf[7])),
+              FormatCount(s[HS_IllegalMoves], buf[8], sizeof(buf[8])));
+    }
+}
+
+/**
+ * Append the transposition table statistics of the last search to
+ * 'file', one line per remaining depth. A header line is written to a new
+ * file. Returns false if the file could not be written.
+ */
+bool WriteHTStatistics(const char *file) {
+    FILE *out = fopen(file, "a");
+
+    if (out == NULL) {
+        Print(0, "Cannot open %s.\n", file);
+        return false;
     }
 
-    total_size -= (1 << ST_Bits) * sizeof(struct STEntry);
+    if (ftell(out) == 0) {
+        fprintf(out, "search,buckets,depth,probes,hits,exact,lower,upper,"
+                     "useless,stores,replaced,illegal\n");
+    }
+
+    for (int i = 0; i < HT_STATS_DEPTHS; i++) {
+        const unsigned long *s = HTStats[i];
+        unsigned long cutoffs =
+            s[HS_ExactCutoffs] + s[HS_LowerCutoffs] + s[HS_UpperCutoffs];
+
+        if (s[HS_Probes] == 0 && s[HS_Stores] == 0) {
+            continue;
+        }
 
-    for (PT_Bits = 1; PT_Bits < 32; PT_Bits++) {
-        long tmp2 = (1 << (PT_Bits + 1)) * sizeof(struct PTEntry);
-        if (tmp2 > total_size)
+        fprintf(out, "%u,%llu,%d,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                HTStatsSearch, (unsigned long long)HT_Size, i,
+                (unsigned long)s[HS_Probes], (unsigned long)s[HS_Hits],
+                (unsigned long)s[HS_ExactCutoffs],
+                (unsigned long)s[HS_LowerCutoffs],
+                (unsigned long)s[HS_UpperCutoffs],
+                (unsigned long)(s[HS_Hits] - cutoffs),
+                (unsigned long)s[HS_Stores], (unsigned long)s[HS_Replaced],
+                (unsigned long)s[HS_IllegalMoves]);
+    }
+
+    fclose(out);
+    return true;
+}
+
+/**
+ * Append the statistics to 'file' after every search, or stop doing so if
+ * 'file' is NULL.
+ */
+void SetHTStatisticsFile(const char *file) {
+    free(HTStatsFile);
+    HTStatsFile = file != NULL ? strdup(file) : NULL;
+}
+
+/**
+ * Largest number of bits such that a table of 2^bits entries of
+ * 'entry_size' bytes fits into 'size' bytes.
+ */
+static int TableBits(uint64_t size, size_t entry_size) {
+    int bits;
+
+    for (bits = 1; bits < MAX_TABLE_BITS; bits++) {
+        if (((uint64_t)1 << (bits + 1)) * entry_size > size)
             break;
     }
+
+    return bits;
+}
+
+/**
+ * Distribute 'size' bytes (with an optional suffix 'k', 'm' or 'g', the
+ * default is kilobytes) over the hashtables. A fifth goes to the pawn and
+ * score tables, the transposition table gets all the rest.
+ */
+void GuessHTSizes(char *size) {
+    char *suffix;
+    uint64_t total_size = strtoull(size, &suffix, 10);
+
+    switch (*suffix) {
+    case 'g':
+    case 'G':
+        total_size <<= 30;
+        break;
+    case 'm':
+    case 'M':
+        total_size <<= 20;
+        break;
+    default:
+        total_size <<= 10;
+        break;
+    }
+
+    if (total_size < 64 * 1024) {
+        Print(0, "I need at least 64k of hashtables.\n");
+        total_size = 64 * 1024;
+    }
+
+    uint64_t eval_size = total_size / 5;
+
+    ST_Bits = TableBits(3 * eval_size / 4, sizeof(struct STEntry));
+    eval_size -= ((uint64_t)1 << ST_Bits) * sizeof(struct STEntry);
+    PT_Bits = TableBits(eval_size, sizeof(struct PTEntry));
+
+    HT_Size = (total_size - ((uint64_t)1 << ST_Bits) * sizeof(struct STEntry) -
+               ((uint64_t)1 << PT_Bits) * sizeof(struct PTEntry)) /
+              sizeof(struct HTBucket);
+    if (HT_Size < 1) {
+        HT_Size = 1;
+    }
+}
+
+/**
+ * The memory used by the transposition, pawn and score tables in bytes.
+ */
+uint64_t HTTotalSize(void) {
+    return HT_Size * sizeof(struct HTBucket) +
+           ((uint64_t)1 << ST_Bits) * sizeof(struct STEntry) +
+           ((uint64_t)1 << PT_Bits) * sizeof(struct PTEntry);
 }
 
 void HashInit(void) {
     int i, j, k;
 
-    InitRandom(0);
+    InitRandom(ZOBRIST_SEED);
 
     for (i = 0; i < 2; i++) {
         for (j = 0; j < 8; j++) {
@@ -658,4 +1579,10 @@ void HashInit(void) {
     }
 
     STMKey = Random64();
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 8; j++) {
+            MaterialKeys[i][j] = Random64();
+        }
+    }
 }
@@ -33,20 +33,28 @@
  * main.c - main program for Amy
  */
 
+#include <ctype.h>
 #include <string.h>
+#include <time.h>
 
+#include "commands.h"
 #include "evaluation_config.h"
+#include "hashmem.h"
 #include "hashtable.h"
 #include "init.h"
 #include "learn.h"
+#include "microbench.h"
 #include "movedata.h"
+#include "perft.h"
 #include "probe.h"
 #include "random.h"
 #include "recog.h"
 #include "search.h"
 #include "state_machine.h"
 #include "test_dbase.h"
+#include "test_hashtable.h"
 #include "test_yaml.h"
+#include "time_ctl.h"
 #include "utils.h"
 
 static char CopyrightNotice[] =
@@ -61,9 +69,27 @@ static char EGTBPath[1024] = "TB";
 
 static char *ConfigFileName = NULL;
 
+/*
+ * Depth and threads of 'Amy --bench', BenchDepth is 0 without it. Threads
+ * default to the -cpu setting.
+ */
+static int BenchDepth = 0;
+static int BenchThreads = 0;
+
+/*
+ * Test suite of 'Amy --perft' with the node rate it must reach: no more
+ * than PerftTolerance percent below PerftBaseline, 0 skips that check.
+ */
+static char *PerftFile = NULL;
+static uint64_t PerftBaseline = 0;
+static int PerftTolerance = 10;
+
+static bool RunMicroBench = false;
+
 static void RunAllTests(void) {
     test_all_yaml();
     test_all_dbase();
+    test_all_hashtable();
 }
 
 static void ProcessOptions(int argc, char *argv[]) {
@@ -88,6 +114,33 @@ static void ProcessOptions(int argc, char *argv[]) {
             RunAllTests();
             exit(0);
         }
+
+        if (!strcmp(argv[i], "--bench")) {
+            BenchDepth = BENCH_DEPTH;
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                BenchDepth = atoi(argv[++i]);
+            }
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                BenchThreads = atoi(argv[++i]);
+            }
+        }
+
+        if (!strcmp(argv[i], "--microbench")) {
+            RunMicroBench = true;
+        }
+
+        if (!strcmp(argv[i], "--perft")) {
+            i++;
+            if (i < argc) {
+                PerftFile = argv[i];
+            }
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                PerftBaseline = strtoull(argv[++i], NULL, 10);
+            }
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                PerftTolerance = atoi(argv[++i]);
+            }
+        }
 #if MP
         if (!strcmp(argv[i], "-cpu")) {
             i++;
@@ -141,6 +194,32 @@ static void ProcessRCFile(void) {
 #endif /* MP */
         } else if (!strcmp(key, "autosave")) {
             AutoSave = !strcmp(value, "true");
+        } else if (!strcmp(key, "hugepages")) {
+            UseHugePages = !strcmp(value, "true");
+        } else if (!strcmp(key, "numa")) {
+            UseParallelFirstTouch = !strcmp(value, "true");
+        } else if (!strcmp(key, "hashstats")) {
+            SetHTStatisticsFile(value);
+        } else if (!strcmp(key, "localeval")) {
+#if MP && HAVE_LIBPTHREAD
+            LocalEvalCaches = !strcmp(value, "true");
+#endif /* MP && HAVE_LIBPTHREAD */
+        } else if (!strcmp(key, "multipv")) {
+            MultiPV = atoi(value);
+            if (MultiPV < 1 || MultiPV > MAX_MULTI_PV) {
+                MultiPV = 1;
+            }
+        } else if (!strcmp(key, "moveoverhead")) {
+            MoveOverhead = atoi(value);
+            if (MoveOverhead < 0) {
+                MoveOverhead = 0;
+            }
+        } else if (!strcmp(key, "smp")) {
+#if MP
+            if (!ParseParallelMode(value, &ParallelMode)) {
+                Print(0, "Unknown parallel search algorithm: %s\n", value);
+            }
+#endif /* MP */
         }
     }
 
@@ -186,17 +265,41 @@ int main(int argc, char *argv[]) {
         LoadEvaluationConfig(ConfigFileName);
     }
 
+    if (PerftFile) {
+        return PerftSuite(PerftFile, PerftBaseline, PerftTolerance) ? 0 : 1;
+    }
+
     AllocateHT();
     InitEGTB(EGTBPath);
     RecogInit();
 
+    if (BenchDepth > 0) {
+        int threads = BenchThreads;
+#if MP
+        if (threads == 0)
+            threads = NumberOfCPUs;
+#endif /* MP */
+        if (BenchDepth > MAX_TREE_SIZE - 2) {
+            Print(0, "Usage: Amy --bench [depth [threads]]\n");
+            return 1;
+        }
+        SearchBench(BenchDepth, threads);
+        return 0;
+    }
+
+    if (RunMicroBench) {
+        MicroBench();
+        return 0;
+    }
+
     DoBookLearning();
 
     Print(0, "\n");
 
     /* Ensure true random behavior. */
-    InitRandom(GetTime());
+    InitRandom((unsigned int)time(NULL));
 
+    StartInputThread();
     StateMachine();
 
     return 0;
@@ -0,0 +1,402 @@
+/*
+
+    Amy - a chess playing program
+
+    Copyright (c) 2002-2025, Thorsten Greiner
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/*
+ * microbench.c - time the primitives of move generation, evaluation and
+ *                hashing in nanoseconds per call
+ */
+
+#include "microbench.h"
+#include "config.h"
+#include "dbase.h"
+#include "evaluation.h"
+#include "hashtable.h"
+#include "heap.h"
+#include "magic.h"
+#include "mates.h"
+#include "search.h"
+#include "swap.h"
+#include "utils.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MICROBENCH_SAMPLES 10
+#define MICROBENCH_SAMPLE_TIME 20000000 /* minimum ns per sample */
+#define MICROBENCH_MAX_MOVES 256
+#define MICROBENCH_HISTORY 8 /* reversible moves played for Repeated() */
+#define MICROBENCH_HT_DEPTH 16 /* depth of the stored entries, one ply */
+
+/*
+ * The positions every primitive is timed on: opening, middlegame, tactics
+ * and endgames.
+ */
+static const char *const MicroBenchPositions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq -",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+    "r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - -",
+    "4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - -",
+    "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - -",
+    "2r3k1/pppR1pp1/4p3/4P1P1/5P2/1P4K1/P1P5/8 w - -",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+    "8/8/4k3/3p4/3P4/4K3/8/8 w - -",
+    NULL};
+
+/* A primitive to time: 'setup' prepares a position, 'run' calls the
+ * primitive 'n' times on it and returns the number of calls made */
+struct MicroBenchmark {
+    const char *mb_Name;
+    void (*mb_Setup)(struct Position *);
+    unsigned long (*mb_Run)(struct Position *, unsigned long);
+};
+
+static heap_t Heap;
+
+/* The legal moves and legal captures of the position set up */
+static move_t Moves[MICROBENCH_MAX_MOVES];
+static int MoveCount;
+static move_t Captures[MICROBENCH_MAX_MOVES];
+static int CaptureCount;
+
+/* The hash keys of the positions after the legal moves */
+static hash_t Keys[MICROBENCH_MAX_MOVES];
+
+/* Results are accumulated here so the calls cannot be optimized away */
+static volatile uint64_t Sink;
+
+static uint64_t NanoTime(void) {
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#else
+    return (uint64_t)GetTime() * (1000000000u / ONE_SECOND);
+#endif
+}
+
+static void SetupMoves(struct Position *p) {
+    push_section(Heap);
+    LegalMoves(p, Heap);
+
+    MoveCount = CaptureCount = 0;
+    for (unsigned int i = Heap->current_section->start;
+         i < Heap->current_section->end && MoveCount < MICROBENCH_MAX_MOVES;
+         i++) {
+        move_t move = Heap->data[i];
+
+        Moves[MoveCount++] = move;
+        if (move & M_CAPTURE)
+            Captures[CaptureCount++] = move;
+    }
+    pop_section(Heap);
+}
+
+static void SetupEvaluation(struct Position *p) {
+    InitEvaluation(p);
+    Sink += EvaluatePosition(p);
+}
+
+static void SetupHashTable(struct Position *p) {
+    SetupMoves(p);
+    for (int i = 0; i < MoveCount; i++) {
+        DoMove(p, Moves[i]);
+        Keys[i] = p->hkey;
+        StoreHT(p->hkey, 0, -INF, INF, M_NONE, MICROBENCH_HT_DEPTH, false,
+                1);
+        UndoMove(p, Moves[i]);
+    }
+}
+
+/*
+ * Play up to MICROBENCH_HISTORY reversible moves, so Repeated() has a game
+ * history to look through.
+ */
+static void SetupHistory(struct Position *p) {
+    for (int n = 0; n < MICROBENCH_HISTORY; n++) {
+        move_t move = M_NONE;
+
+        SetupMoves(p);
+        for (int i = 0; i < MoveCount; i++) {
+            if (!(Moves[i] & (M_CAPTURE | M_CANY)) &&
+                TYPE(p->piece[M_FROM(Moves[i])]) != Pawn) {
+                move = Moves[i];
+                break;
+            }
+        }
+        if (move == M_NONE)
+            break;
+        DoMove(p, move);
+    }
+}
+
+static unsigned long RunDoMove(struct Position *p, unsigned long n) {
+    for (unsigned long k = 0; k < n; k++) {
+        for (int i = 0; i < MoveCount; i++) {
+            DoMove(p, Moves[i]);
+            UndoMove(p, Moves[i]);
+        }
+    }
+    return n * MoveCount;
+}
+
+static unsigned long RunGenTo(struct Position *p, unsigned long n) {
+    unsigned long ops = 0;
+
+    for (unsigned long k = 0; k < n; k++) {
+        BitBoard tmp = p->mask[OPP(p->turn)][0];
+
+        while (tmp) {
+            int sq = FindSetBit(tmp);
+            tmp &= tmp - 1;
+            push_section(Heap);
+            GenTo(p, sq, Heap);
+            pop_section(Heap);
+            ops++;
+        }
+    }
+    return ops;
+}
+
+static unsigned long RunGenFrom(struct Position *p, unsigned long n) {
+    unsigned long ops = 0;
+
+    for (unsigned long k = 0; k < n; k++) {
+        BitBoard tmp = p->mask[p->turn][0];
+
+        while (tmp) {
+            int sq = FindSetBit(tmp);
+            tmp &= tmp - 1;
+            push_section(Heap);
+            GenFrom(p, sq, Heap);
+            pop_section(Heap);
+            ops++;
+        }
+    }
+    return ops;
+}
+
+static unsigned long RunLegalMoves(struct Position *p, unsigned long n) {
+    for (unsigned long k = 0; k < n; k++) {
+        push_section(Heap);
+        Sink += LegalMoves(p, Heap);
+        pop_section(Heap);
+    }
+    return n;
+}
+
+static unsigned long RunSwapOff(struct Position *p, unsigned long n) {
+    for (unsigned long k = 0; k < n; k++) {
+        for (int i = 0; i < CaptureCount; i++) {
+            Sink += SwapOff(p, Captures[i]);
+        }
+    }
+    return n * CaptureCount;
+}
+
+static unsigned long RunEvaluate(struct Position *p, unsigned long n) {
+    for (unsigned long k = 0; k < n; k++) {
+        Sink += EvaluatePosition(p);
+    }
+    return n;
+}
+
+/* Invalidating the evaluation tables before every call forces a full
+ * evaluation without pawn, score or material table hits */
+static unsigned long RunEvaluateNoHits(struct Position *p, unsigned long n) {
+    for (unsigned long k = 0; k < n; k++) {
+        ClearPawnHashTable();
+        Sink += EvaluatePosition(p);
+    }
+    return n;
+}
+
+static unsigned long RunProbeHT(struct Position *p, unsigned long n) {
+    (void)p;
+    for (unsigned long k = 0; k < n; k++) {
+        for (int i = 0; i < MoveCount; i++) {
+            int score;
+            move_t move;
+            bool threat;
+
+            Sink += ProbeHT(Keys[i], &score, MICROBENCH_HT_DEPTH, &move,
+                            &threat, 1);
+        }
+    }
+    return n * MoveCount;
+}
+
+static unsigned long RunRookAttacks(struct Position *p, unsigned long n) {
+    BitBoard occupied = p->mask[White][0] | p->mask[Black][0];
+
+    for (unsigned long k = 0; k < n; k++) {
+        for (int sq = 0; sq < 64; sq++) {
+            Sink ^= rook_attacks(sq, occupied);
+        }
+    }
+    return n * 64;
+}
+
+static unsigned long RunBishopAttacks(struct Position *p, unsigned long n) {
+    BitBoard occupied = p->mask[White][0] | p->mask[Black][0];
+
+    for (unsigned long k = 0; k < n; k++) {
+        for (int sq = 0; sq < 64; sq++) {
+            Sink ^= bishop_attacks(sq, occupied);
+        }
+    }
+    return n * 64;
+}
+
+static unsigned long RunIsCheckingMove(struct Position *p, unsigned long n) {
+    for (unsigned long k = 0; k < n; k++) {
+        for (int i = 0; i < MoveCount; i++) {
+            Sink += IsCheckingMove(p, Moves[i]);
+        }
+    }
+    return n * MoveCount;
+}
+
+static unsigned long RunRepeated(struct Position *p, unsigned long n) {
+    for (unsigned long k = 0; k < n; k++) {
+        Sink += Repeated(p, false);
+    }
+    return n;
+}
+
+static unsigned long RunMateThreat(struct Position *p, unsigned long n) {
+    for (unsigned long k = 0; k < n; k++) {
+        Sink += MateThreat(p, OPP(p->turn));
+    }
+    return n;
+}
+
+static const struct MicroBenchmark MicroBenchmarks[] = {
+    {"DoMove/UndoMove", SetupMoves, RunDoMove},
+    {"GenTo", NULL, RunGenTo},
+    {"GenFrom", NULL, RunGenFrom},
+    {"LegalMoves", NULL, RunLegalMoves},
+    {"SwapOff", SetupMoves, RunSwapOff},
+    {"EvaluatePosition", SetupEvaluation, RunEvaluate},
+    {"EvaluatePosition no hits", SetupEvaluation, RunEvaluateNoHits},
+    {"ProbeHT", SetupHashTable, RunProbeHT},
+    {"rook_attacks", NULL, RunRookAttacks},
+    {"bishop_attacks", NULL, RunBishopAttacks},
+    {"IsCheckingMove", SetupMoves, RunIsCheckingMove},
+    {"Repeated", SetupHistory, RunRepeated},
+    {"MateThreat", NULL, RunMateThreat},
+    {NULL, NULL, NULL}};
+
+/*
+ * Time 'n' rounds of a benchmark on every position. Returns the time per
+ * call in ns and the total time of the timed runs in 'elapsed'.
+ */
+static double Sample(const struct MicroBenchmark *mb, unsigned long n,
+                     uint64_t *elapsed) {
+    unsigned long ops = 0;
+
+    *elapsed = 0;
+    for (int i = 0; MicroBenchPositions[i] != NULL; i++) {
+        char line[256];
+
+        strcpy(line, MicroBenchPositions[i]);
+        struct Position *p = CreatePositionFromEPD(line);
+        if (mb->mb_Setup != NULL)
+            mb->mb_Setup(p);
+
+        uint64_t start = NanoTime();
+        ops += mb->mb_Run(p, n);
+        *elapsed += NanoTime() - start;
+
+        FreePosition(p);
+    }
+
+    return (ops > 0) ? (double)*elapsed / ops : 0.0;
+}
+
+/**
+ * Time the primitives of move generation, evaluation and hashing on a
+ * fixed set of positions. Every benchmark is calibrated to run for at
+ * least MICROBENCH_SAMPLE_TIME ns per sample, then MICROBENCH_SAMPLES
+ * samples are taken and the mean, standard deviation and minimum of the
+ * time per call are printed. The log file is closed for the run, the setup
+ * of the positions would fill it.
+ */
+void MicroBench(void) {
+    const int verbosity = Verbosity;
+
+    CloseLogFile();
+    Heap = allocate_heap();
+
+    Print(0, "%-26s %10s %10s %10s\n", "Benchmark", "ns/op", "stddev",
+          "min");
+
+    for (const struct MicroBenchmark *mb = MicroBenchmarks;
+         mb->mb_Name != NULL; mb++) {
+        double ns[MICROBENCH_SAMPLES];
+        double mean = 0.0, var = 0.0, min;
+        unsigned long n = 1;
+        uint64_t elapsed;
+
+        /* InitEvaluation() reports the game phase of every position */
+        Verbosity = 1;
+        /* calibrate, this also warms up the caches */
+        for (;;) {
+            Sample(mb, n, &elapsed);
+            if (elapsed >= MICROBENCH_SAMPLE_TIME)
+                break;
+            n *= 2;
+        }
+
+        for (int s = 0; s < MICROBENCH_SAMPLES; s++) {
+            ns[s] = Sample(mb, n, &elapsed);
+            mean += ns[s];
+        }
+        mean /= MICROBENCH_SAMPLES;
+
+        min = ns[0];
+        for (int s = 0; s < MICROBENCH_SAMPLES; s++) {
+            var += (ns[s] - mean) * (ns[s] - mean);
+            if (ns[s] < min)
+                min = ns[s];
+        }
+        var /= MICROBENCH_SAMPLES - 1;
+        Verbosity = verbosity;
+
+        Print(0, "%-26s %10.1f %10.2f %10.1f\n", mb->mb_Name, mean, sqrt(var),
+              min);
+    }
+
+    free_heap(Heap);
+    Heap = NULL;
+}
@@ -44,13 +44,20 @@
 #include "swap.h"
 #include "utils.h"
 
+#include <string.h>
+
 struct SearchData *CreateSearchData(struct Position *p) {
-    struct SearchData *sd = calloc(1, sizeof(struct SearchData));
-    if (!sd) {
+    void *mem = calloc(1, sizeof(struct SearchData) + CACHE_LINE_SIZE);
+    if (!mem) {
         Print(0, "Cannot allocate SearchData.\n");
         exit(1);
     }
 
+    /* align for the search statistics */
+    struct SearchData *sd =
+        (void *)(((uintptr_t)mem + CACHE_LINE_SIZE - 1) &
+                 ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+    sd->allocation = mem;
     sd->position = p;
 
     sd->statusTable = calloc(MAX_TREE_SIZE, sizeof(struct SearchStatus));
@@ -73,11 +80,6 @@ struct SearchData *CreateSearchData(struct Position *p) {
     sd->data_heap_size = 0;
 
 #if MP
-    sd->localHashTable = calloc(sizeof(struct HTEntry), L_HT_Size);
-    if (!sd->localHashTable) {
-        Print(0, "Cannot allocate thread-local hashtable.\n");
-        exit(1);
-    }
     sd->deferred_heap = allocate_heap();
 #endif
 
@@ -93,11 +95,42 @@ void FreeSearchData(struct SearchData *sd) {
     free_heap(sd->heap);
 
 #if MP
-    free(sd->localHashTable);
     free_heap(sd->deferred_heap);
 #endif
 
-    free(sd);
+    free(sd->allocation);
+}
+
+/**
+ * Prepare 'sd' for a new search of position 'p', as if it had just been
+ * created by CreateSearchData().
+ */
+void ResetSearchData(struct SearchData *sd, struct Position *p) {
+    sd->position = p;
+
+    memset(sd->statusTable, 0, MAX_TREE_SIZE * sizeof(struct SearchStatus));
+    sd->current = sd->statusTable;
+
+    memset(sd->killerTable, 0, MAX_TREE_SIZE * sizeof(struct KillerEntry));
+    sd->killer = sd->killerTable;
+
+    clear_heap(sd->heap);
+#if MP
+    clear_heap(sd->deferred_heap);
+#endif
+
+    memset(sd->counterTab, 0, sizeof(sd->counterTab));
+    memset(sd->historyTab, 0, sizeof(sd->historyTab));
+    memset(sd->pv_save, 0, sizeof(sd->pv_save));
+
+    sd->ply = 0;
+    sd->nodes_cnt = sd->qnodes_cnt = sd->check_nodes_cnt = 0;
+    sd->best_move = M_NONE;
+    sd->depth = 0;
+    sd->nrootmoves = 0;
+    sd->movenum = 0;
+
+    memset(&sd->stats, 0, sizeof(sd->stats));
 }
 
 void EnterNode(struct SearchData *sd) {
@@ -152,6 +185,10 @@ move_t NextMove(struct SearchData *sd) {
             st->st_phase = GenerateCaptures;
             return st->st_hashmove;
         } else {
+            if (st->st_hashmove != M_NONE) {
+                sd->stats.ss_HIllegal++;
+                CountHT(HS_IllegalMoves, st->st_depth);
+            }
             st->st_hashmove = M_NONE;
         }
     /* fall through */
@@ -441,6 +478,10 @@ move_t NextEvasion(struct SearchData *sd) {
             st->st_phase = GenerateCaptures;
             return st->st_hashmove;
         } else {
+            if (st->st_hashmove != M_NONE) {
+                sd->stats.ss_HIllegal++;
+                CountHT(HS_IllegalMoves, st->st_depth);
+            }
             st->st_hashmove = M_NONE;
         }
         /* fall through */
@@ -0,0 +1,495 @@
+/*
+
+    Amy - a chess playing program
+
+    Copyright (c) 2002-2025, Thorsten Greiner
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/*
+ * perft.c - count the leaf nodes of the move tree to verify the move
+ *           generator
+ */
+
+#include "perft.h"
+#include "config.h"
+#include "dbase.h"
+#include "hashmem.h"
+#include "hashtable.h"
+#include "heap.h"
+#include "init.h"
+#include "inline.h"
+#include "magic.h"
+#include "search.h"
+#include "utils.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if MP && HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+/*
+ * An entry of the perft hashtable: the number of leaf nodes below a
+ * position at a depth. Like the transposition table the key is stored
+ * XOR'ed with the data, so entries torn by concurrent writes are detected.
+ */
+struct PerftEntry {
+    hash_t pe_Key;
+    uint64_t pe_Data; /* count << 8 | depth */
+};
+
+#define PERFT_DEPTH_MASK 0xff
+#define PERFT_SUITE_DEPTHS 16 /* depths checked per suite position */
+
+static struct HashMemory PerftMemory;
+static struct PerftEntry *PerftTable = NULL;
+static uint64_t PerftSize = 0;
+
+/* A root move and the number of leaf nodes below it */
+struct PerftRootMove {
+    move_t prm_Move;
+    uint64_t prm_Count;
+};
+
+/* The root moves shared by the perft threads */
+struct PerftRoot {
+    struct Position *pr_Position;
+    struct PerftRootMove *pr_Moves;
+    int pr_Count;
+    int pr_Next; /* the next root move to count */
+    int pr_Depth;
+#if MP && HAVE_LIBPTHREAD
+    pthread_mutex_t pr_Lock;
+#endif
+};
+
+/**
+ * Resize the perft hashtable to 'size' bytes (k, m or g suffix, kilobytes
+ * by default). A size of 0 switches it off.
+ */
+void SetPerftHashSize(const char *size) {
+    char *suffix;
+    uint64_t bytes = strtoull(size, &suffix, 10);
+
+    switch (*suffix) {
+    case 'g':
+    case 'G':
+        bytes <<= 30;
+        break;
+    case 'm':
+    case 'M':
+        bytes <<= 20;
+        break;
+    default:
+        bytes <<= 10;
+        break;
+    }
+
+    FreeHashMemory(&PerftMemory);
+    PerftTable = NULL;
+    PerftSize = 0;
+
+    if (bytes < sizeof(struct PerftEntry))
+        return;
+
+    PerftTable = AllocateHashMemory(&PerftMemory, bytes);
+    if (PerftTable == NULL) {
+        Print(0, "Cannot allocate perft hashtable.\n");
+        return;
+    }
+    PerftSize = bytes / sizeof(struct PerftEntry);
+}
+
+/**
+ * The size of the perft hashtable in bytes, 0 if there is none.
+ */
+uint64_t PerftHashSize(void) { return PerftSize * sizeof(struct PerftEntry); }
+
+static inline struct PerftEntry *PerftSlot(hash_t key, int depth) {
+    return PerftTable +
+           HashIndex(key ^ ((uint64_t)depth * 0x9e3779b97f4a7c15ULL),
+                     PerftSize);
+}
+
+/*
+ * The pieces of the side to move which are pinned to their king.
+ */
+static BitBoard PinnedPieces(const struct Position *p) {
+    int side = p->turn;
+    int ksq = p->kingSq[side];
+    BitBoard all = p->mask[White][0] | p->mask[Black][0];
+    BitBoard enemy = p->mask[OPP(side)][0];
+    BitBoard queens = p->mask[OPP(side)][Queen];
+    BitBoard pinned = 0;
+
+    /* enemy sliders seeing the king through the pieces of the side only */
+    BitBoard snipers =
+        (rook_attacks(ksq, enemy) & (p->mask[OPP(side)][Rook] | queens)) |
+        (bishop_attacks(ksq, enemy) & (p->mask[OPP(side)][Bishop] | queens));
+
+    while (snipers) {
+        int sq = FindSetBit(snipers);
+        snipers &= snipers - 1;
+
+        BitBoard between = InterPath[ksq][sq] & all;
+        if (CountBits(between) == 1)
+            pinned |= between & p->mask[side][0];
+    }
+
+    return pinned;
+}
+
+/*
+ * Count the legal moves of 'p' without making them where possible: if the
+ * side to move is not in check, a move by an unpinned piece other than the
+ * king is legal. King moves, castling, en passant captures, moves of pinned
+ * pieces and check evasions are tested by making the move.
+ */
+static uint64_t BulkCount(struct Position *p, heap_t heap) {
+    BitBoard verify;
+    uint64_t cnt = 0;
+    unsigned int i;
+
+    if (InCheck(p, p->turn))
+        verify = ~(BitBoard)0;
+    else
+        verify = PinnedPieces(p) | SetMask(p->kingSq[p->turn]);
+
+    push_section(heap);
+    PLegalMoves(p, heap);
+
+    for (i = heap->current_section->start; i < heap->current_section->end;
+         i++) {
+        move_t move = heap->data[i];
+
+        if (!(move & M_ENPASSANT) && !TstBit(verify, M_FROM(move))) {
+            cnt++;
+            continue;
+        }
+
+        if (move & M_CANY && !MayCastle(p, move))
+            continue;
+
+        DoMove(p, move);
+        if (!InCheck(p, OPP(p->turn))) {
+            cnt++;
+        }
+        UndoMove(p, move);
+    }
+    pop_section(heap);
+
+    return cnt;
+}
+
+/*
+ * Count the leaf nodes 'depth' plies below 'p'. The last ply is bulk
+ * counted.
+ */
+static uint64_t PerftCount(struct Position *p, int depth, heap_t heap) {
+    struct PerftEntry *slot = NULL;
+    uint64_t cnt = 0;
+    unsigned int i;
+
+    if (depth == 1)
+        return BulkCount(p, heap);
+
+    if (PerftTable != NULL) {
+        slot = PerftSlot(p->hkey, depth);
+
+        struct PerftEntry entry = *slot;
+        if ((entry.pe_Key ^ entry.pe_Data) == p->hkey &&
+            (int)(entry.pe_Data & PERFT_DEPTH_MASK) == depth) {
+            return entry.pe_Data >> 8;
+        }
+    }
+
+    push_section(heap);
+    PLegalMoves(p, heap);
+
+    for (i = heap->current_section->start; i < heap->current_section->end;
+         i++) {
+        move_t move = heap->data[i];
+        if (move & M_CANY && !MayCastle(p, move))
+            continue;
+
+        DoMove(p, move);
+        if (!InCheck(p, OPP(p->turn))) {
+            cnt += PerftCount(p, depth - 1, heap);
+        }
+        UndoMove(p, move);
+    }
+    pop_section(heap);
+
+    if (slot != NULL) {
+        uint64_t data = cnt << 8 | (uint64_t)depth;
+        struct PerftEntry entry = {.pe_Key = p->hkey ^ data, .pe_Data = data};
+        *slot = entry;
+    }
+
+    return cnt;
+}
+
+/*
+ * Count the root moves handed out by 'root' until there are none left.
+ */
+static void *PerftWorker(void *x) {
+    struct PerftRoot *root = x;
+    struct Position *p = ClonePosition(root->pr_Position);
+    heap_t heap = allocate_heap();
+
+    for (;;) {
+        int next;
+
+#if MP && HAVE_LIBPTHREAD
+        pthread_mutex_lock(&root->pr_Lock);
+#endif
+        next = root->pr_Next++;
+#if MP && HAVE_LIBPTHREAD
+        pthread_mutex_unlock(&root->pr_Lock);
+#endif
+        if (next >= root->pr_Count)
+            break;
+
+        struct PerftRootMove *rm = root->pr_Moves + next;
+
+        DoMove(p, rm->prm_Move);
+        rm->prm_Count =
+            (root->pr_Depth > 1) ? PerftCount(p, root->pr_Depth - 1, heap) : 1;
+        UndoMove(p, rm->prm_Move);
+    }
+
+    free_heap(heap);
+    FreePosition(p);
+
+    return NULL;
+}
+
+/*
+ * Print a move in coordinate notation as used by other programs' divide
+ * output, e.g. e2e4 or e7e8q.
+ */
+static char *CoordinateMove(move_t move, char *buffer) {
+    char *x = buffer;
+
+    *(x++) = 'a' + (M_FROM(move) & 7);
+    *(x++) = '1' + (M_FROM(move) >> 3);
+    *(x++) = 'a' + (M_TO(move) & 7);
+    *(x++) = '1' + (M_TO(move) >> 3);
+    if (move & M_PROMOTION_MASK) {
+        *(x++) = tolower((unsigned char)PieceName[PromoType(move)]);
+    }
+    *x = '\0';
+
+    return buffer;
+}
+
+/**
+ * Count the leaf nodes 'depth' plies below 'p'. The root moves are split
+ * among 'threads' threads, which share the perft hashtable if there is
+ * one. If 'divide' is true the count of every root move is printed.
+ */
+uint64_t Perft(struct Position *p, int depth, int threads, bool divide) {
+    struct PerftRoot root = {.pr_Position = p, .pr_Depth = depth};
+    heap_t heap;
+    uint64_t total = 0;
+    unsigned int i;
+
+    if (depth <= 0)
+        return 1;
+
+    if (PerftTable != NULL)
+        ClearHashMemory(PerftTable, PerftSize * sizeof(struct PerftEntry));
+
+    heap = allocate_heap();
+    PLegalMoves(p, heap);
+    root.pr_Moves = calloc(heap->current_section->end -
+                               heap->current_section->start,
+                           sizeof(struct PerftRootMove));
+    if (root.pr_Moves == NULL) {
+        free_heap(heap);
+        return 0;
+    }
+
+    for (i = heap->current_section->start; i < heap->current_section->end;
+         i++) {
+        move_t move = heap->data[i];
+        if (move & M_CANY && !MayCastle(p, move))
+            continue;
+
+        DoMove(p, move);
+        if (!InCheck(p, OPP(p->turn))) {
+            root.pr_Moves[root.pr_Count++].prm_Move = move;
+        }
+        UndoMove(p, move);
+    }
+    free_heap(heap);
+
+#if MP && HAVE_LIBPTHREAD
+    pthread_t *helpers = NULL;
+    int started = 0;
+
+    if (threads > root.pr_Count)
+        threads = root.pr_Count;
+    if (threads > 1)
+        helpers = calloc(threads - 1, sizeof(pthread_t));
+
+    pthread_mutex_init(&root.pr_Lock, NULL);
+    for (int t = 0; helpers != NULL && t < threads - 1; t++) {
+        if (pthread_create(helpers + t, NULL, &PerftWorker, &root) != 0)
+            break;
+        started++;
+    }
+    PerftWorker(&root);
+    for (int t = 0; t < started; t++) {
+        pthread_join(helpers[t], NULL);
+    }
+    pthread_mutex_destroy(&root.pr_Lock);
+    free(helpers);
+#else
+    (void)threads;
+    PerftWorker(&root);
+#endif /* MP && HAVE_LIBPTHREAD */
+
+    for (int m = 0; m < root.pr_Count; m++) {
+        total += root.pr_Moves[m].prm_Count;
+        if (divide) {
+            char buffer[8];
+
+            Print(0, "%s: %llu\n", CoordinateMove(root.pr_Moves[m].prm_Move,
+                                                  buffer),
+                  (unsigned long long)root.pr_Moves[m].prm_Count);
+        }
+    }
+
+    free(root.pr_Moves);
+
+    return total;
+}
+
+/**
+ * Run the perft test suite in 'fname'. Every line holds an EPD followed by
+ * operations ";D<depth> <count>" with the leaf node counts expected at
+ * these depths; lines starting with '#' are comments. The node rate of the
+ * deepest count of every position is reported. Returns false if a count
+ * differs or if the overall node rate is more than 'tolerance' percent
+ * below 'baseline' nodes per second; a baseline of 0 skips that check.
+ */
+bool PerftSuite(const char *fname, uint64_t baseline, int tolerance) {
+    FILE *fin = fopen(fname, "r");
+    char line[256];
+    uint64_t total = 0;
+    unsigned int elapsed = 0;
+    int npos = 0, failed = 0;
+
+    if (!fin) {
+        Print(0, "Couldn't open %s for input.\n", fname);
+        return false;
+    }
+
+    Print(0, "  Pos  Depth         Nodes     Time     Nodes/s\n");
+
+    while (fgets(line, sizeof(line), fin)) {
+        int depth[PERFT_SUITE_DEPTHS];
+        uint64_t expected[PERFT_SUITE_DEPTHS];
+        int n = 0;
+        char *op;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+
+        /* ReadEPD uses strtok, so parse the operations first */
+        op = strchr(line, ';');
+        if (op != NULL) {
+            char *end = op;
+
+            *op++ = '\0';
+            while (end > line && isspace((unsigned char)end[-1]))
+                *--end = '\0';
+            for (op = strtok(op, ";"); op != NULL; op = strtok(NULL, ";")) {
+                while (isspace((unsigned char)*op))
+                    op++;
+                if (*op == 'D' && n < PERFT_SUITE_DEPTHS) {
+                    char *count;
+                    depth[n] = (int)strtol(op + 1, &count, 10);
+                    expected[n] = strtoull(count, NULL, 10);
+                    n++;
+                }
+            }
+        }
+
+        npos++;
+        struct Position *p = CreatePositionFromEPD(line);
+
+        for (int i = 0; i < n; i++) {
+            unsigned int start = GetTime();
+            uint64_t cnt = Perft(p, depth[i], 1, false);
+            unsigned int time = GetTime() - start;
+
+            if (cnt != expected[i]) {
+                Print(0, "%5d %6d  %12llu  expected %llu: %s\n", npos,
+                      depth[i], (unsigned long long)cnt,
+                      (unsigned long long)expected[i], line);
+                failed++;
+            } else if (i == n - 1) {
+                double secs = (double)time / ONE_SECOND;
+
+                Print(0, "%5d %6d  %12llu  %7.3f  %10.0f\n", npos, depth[i],
+                      (unsigned long long)cnt, secs,
+                      (secs > 0.0) ? cnt / secs : 0.0);
+                total += cnt;
+                elapsed += time;
+            }
+        }
+
+        FreePosition(p);
+    }
+    fclose(fin);
+
+    double secs = (double)elapsed / ONE_SECOND;
+    double nps = (secs > 0.0) ? total / secs : 0.0;
+
+    Print(0, "Total        %12llu  %7.3f  %10.0f\n", (unsigned long long)total,
+          secs, nps);
+
+    if (failed > 0) {
+        Print(0, "Wrong perft counts: %d\n", failed);
+        return false;
+    }
+
+    if (baseline > 0 && nps < (double)baseline * (100 - tolerance) / 100) {
+        Print(0, "Node rate %.0f is more than %d%% below the baseline %llu.\n",
+              nps, tolerance, (unsigned long long)baseline);
+        return false;
+    }
+
+    Print(0, "All %d positions passed.\n", npos);
+
+    return true;
+}
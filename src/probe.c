@@ -9,6 +9,7 @@
 
 #include "config.h"
 #include "dbase.h"
+#include "hashtable.h"
 #include "search.h"
 #include "utils.h"
 #include <stdlib.h>
@@ -58,7 +59,6 @@ extern int FTbSetCacheSize(void *buffer, unsigned long size);
 extern int TB_CRC_CHECK;
 
 static int EGTBMenCount;
-int EGTBProbe, EGTBProbeSucc;
 
 #if MP && HAVE_LIBPTHREAD
 static pthread_mutex_t EGTBMutex = PTHREAD_MUTEX_INITIALIZER;
@@ -101,7 +101,7 @@ int ProbeEGTB(const struct Position *p, int *score, int ply) {
     if (CountBits(p->mask[White][0] | p->mask[Black][0]) > EGTBMenCount)
         return 0;
 
-    EGTBProbe++;
+    ThreadStats->ss_EGTBProbe++;
     InitializeCounters(pcCount, wSquares, 0, p->mask[White][Pawn]);
     InitializeCounters(pcCount + 1, wSquares, 1, p->mask[White][Knight]);
     InitializeCounters(pcCount + 2, wSquares, 2, p->mask[White][Bishop]);
@@ -163,7 +163,7 @@ int ProbeEGTB(const struct Position *p, int *score, int ply) {
 
         *score = value;
 
-        EGTBProbeSucc++;
+        ThreadStats->ss_EGTBProbeSucc++;
         result = 1;
     } while (0);
 
@@ -46,7 +46,6 @@
 #include "mates.h"
 #include "next.h"
 #include "probe.h"
-#include "random.h"
 #include "recog.h"
 #include "search_io.h"
 #include "state_machine.h"
@@ -54,6 +53,7 @@
 #include "time_ctl.h"
 #include "utils.h"
 
+#include <limits.h>
 #include <string.h>
 
 #if HAVE_LIBPTHREAD
@@ -123,7 +123,6 @@ static const int MateDepth = 3;
 
 int MaxDepth;
 
-unsigned long RCExt, ChkExt, DiscExt, DblExt, SingExt, PPExt, ZZExt;
 unsigned int HardLimit, SoftLimit, SoftLimit2;
 unsigned int StartTime, WallTimeStart;
 unsigned int CurTime;
@@ -135,12 +134,35 @@ static int MaxSearchDepth = MAX_TREE_SIZE - 1;
 int DoneAtRoot;
 static int EGTBDepth = 0;
 
+/*
+ * Nodes the master searches between two looks at the clock and the input,
+ * see SetNodesPerCheck().
+ */
 static int NodesPerCheck;
 
-static OPTIONAL_ATOMIC unsigned long TotalNodes;
+#define NODES_PER_CHECK_MIN 1000
+#define CHECKS_PER_BUDGET 20
+#define CHECK_INTERVAL_MAX (ONE_SECOND / 10)
+
+/*
+ * Fixed depth and node limits, 0 if not set. When set they replace the time
+ * control, so a single threaded search is reproducible.
+ */
+int DepthLimit = 0;
+unsigned long NodeLimit = 0;
+static unsigned long SearchNodeLimit = 0; /* node limit of this search */
+
+/* Time (in GetTime() units) at which each iteration was completed */
+static int DepthTime[MAX_TREE_SIZE];
+
+/* Nodes searched by all threads in the last search */
+static unsigned long SearchNodes = 0;
 
 #if MP
 int NumberOfCPUs;
+smp_mode_t ParallelMode = SMP_ABDADA;
+
+static const char *const ParallelModeNames[] = {"abdada", "lazy"};
 #endif
 
 /*
@@ -168,10 +190,18 @@ static char BestLine[2048];
 static char ShortBestLine[2048];
 static char AnalysisLine[4096];
 
-OPTIONAL_ATOMIC unsigned long HTry, HHit, PTry, PHit, STry, SHit;
+/* Multi-PV: number of lines to search and the lines of the last iteration */
+int MultiPV = 1;
+static char MultiPVLine[MAX_MULTI_PV][2048];
+static char MultiPVResult[MAX_MULTI_PV][2048];
+static int MultiPVScore[MAX_MULTI_PV];
+static int MultiPVCount = 0;
+static int MultiPVDepth = 0;
+static int MultiPVTurn = White;
 
 /* prototypes for search routines */
 
+static unsigned long SumSearchStats(struct SearchData *, struct SearchStats *);
 static int quies(struct SearchData *, int, int, int);
 #if MP
 static int negascout(struct SearchData *, int, int, int, int, int);
@@ -181,6 +211,32 @@ static int negascout(struct SearchData *, int, int, int, int);
 
 /* search routines */
 
+/*
+ * Size NodesPerCheck from the node rate of 'sd' so the clock is read about
+ * CHECKS_PER_BUDGET times up to the hard time limit, at least every
+ * CHECK_INTERVAL_MAX and at most every millisecond. A sub-second budget
+ * would otherwise be overshot by a whole check interval.
+ */
+static void SetNodesPerCheck(struct SearchData *sd) {
+    unsigned int elapsed = CurTime - StartTime;
+    unsigned int interval = (HardLimit - StartTime) / CHECKS_PER_BUDGET;
+    uint64_t nodes;
+
+    if (interval > CHECK_INTERVAL_MAX)
+        interval = CHECK_INTERVAL_MAX;
+    if (interval < 1)
+        interval = 1;
+
+    if (elapsed == 0) {
+        NodesPerCheck = NODES_PER_CHECK_MIN;
+        return;
+    }
+
+    nodes = (uint64_t)(sd->nodes_cnt + sd->qnodes_cnt) * interval / elapsed;
+    NodesPerCheck = (nodes < NODES_PER_CHECK_MIN) ? NODES_PER_CHECK_MIN
+                                                  : (int)nodes;
+}
+
 /*
  * Check if search should be terminated
  *
@@ -189,13 +245,28 @@ static int negascout(struct SearchData *, int, int, int, int);
  *
  */
 static bool TerminateSearch(struct SearchData *sd) {
-    if ((sd->nodes_cnt + sd->qnodes_cnt) > sd->check_nodes_cnt) {
+    if ((sd->nodes_cnt + sd->qnodes_cnt) > sd->check_nodes_cnt ||
+        InputWaiting()) {
         unsigned int now = GetTime();
 
         sd->check_nodes_cnt = sd->nodes_cnt + sd->qnodes_cnt + NodesPerCheck;
         if (AbortSearch)
             return true;
 
+        if (sd->master && SearchNodeLimit != 0) {
+            if (SumSearchStats(sd, NULL) >= SearchNodeLimit) {
+                AbortSearch = true;
+                return true;
+            }
+
+            /*
+             * Check again exactly when the limit is reached.
+             */
+
+            if (sd->check_nodes_cnt >= SearchNodeLimit)
+                sd->check_nodes_cnt = SearchNodeLimit - 1;
+        }
+
         CurTime = now;
         if (CurTime > (StartTime + ONE_SECOND))
             PrintOK = true;
@@ -212,7 +283,8 @@ static bool TerminateSearch(struct SearchData *sd) {
 
             if (buffer[0] == '.') {
                 PrintNoLog(0, "stat01: %d %ld %d %d %d\n",
-                           (CurTime - StartTime), TotalNodes, sd->depth,
+                           CENTISECONDS(CurTime - StartTime),
+                           SumSearchStats(sd, NULL), sd->depth,
                            sd->nrootmoves - sd->movenum - 1, sd->nrootmoves);
             }
 
@@ -268,6 +340,24 @@ static bool TerminateSearch(struct SearchData *sd) {
     return false;
 }
 
+/**
+ * Prefetch the hashtable entries the child position just entered by
+ * DoMove() will probe: the transposition table bucket for 'negascout'
+ * children, the score table entry for 'quies' children and the pawn
+ * table entry if a pawn moved.
+ */
+static inline void PrefetchChild(struct Position *p, bool full_width) {
+    if (full_width) {
+        PrefetchHT(p->hkey);
+    } else {
+        PrefetchST(p->hkey);
+    }
+
+    if (p->pkey != (p->actLog - 1)->gl_PawnKey) {
+        PrefetchPT(p->pkey);
+    }
+}
+
 /*
  * Support routine for recpature extensions
  */
@@ -290,7 +380,8 @@ static bool IsRecapture(int piece1, int piece2) {
  *
  */
 
-static int CheckExtend(struct Position *p) {
+static int CheckExtend(struct SearchData *sd) {
+    struct Position *p = sd->position;
     int kp = p->kingSq[p->turn];
     BitBoard att;
 
@@ -309,7 +400,7 @@ static int CheckExtend(struct Position *p) {
         int i;
         int cnt = 0;
 
-        DblExt++;
+        sd->stats.ss_DblExt++;
 
         ff = KingEPM[kp] & ~p->mask[p->turn][0];
         att &= p->slidingPieces;
@@ -340,7 +431,7 @@ static int CheckExtend(struct Position *p) {
 
         /* discovered check */
         if (atp != M_TO((p->actLog - 1)->gl_Move)) {
-            DiscExt++;
+            sd->stats.ss_DiscExt++;
             nd = ExtendDiscoveredCheck;
         }
 
@@ -424,7 +515,7 @@ static int CheckExtend(struct Position *p) {
 
     /* If we get here, we have only one legal move. */
 
-    SingExt++;
+    sd->stats.ss_SingExt++;
     return ExtendSingularReply;
 }
 
@@ -466,12 +557,7 @@ static void StoreResult(struct SearchData *sd, int score, int alpha, int beta,
         sd->historyTab[p->turn][move & 4095] += depth * depth;
     }
 
-    StoreHT(p->hkey, score, alpha, beta, move, depth, threat, sd->ply
-#if MP
-            ,
-            sd->localHashTable
-#endif
-    );
+    StoreHT(p->hkey, score, alpha, beta, move, depth, threat, sd->ply);
 }
 
 /*
@@ -492,7 +578,6 @@ static int quies(struct SearchData *sd, int alpha, int beta, int depth) {
     EnterNode(sd);
 
     sd->qnodes_cnt++;
-    TotalNodes++;
 
     /* max search depth reached */
     if (sd->ply >= MaxDepth || Repeated(p, false)) {
@@ -536,6 +621,7 @@ static int quies(struct SearchData *sd, int alpha, int beta, int depth) {
 
     while ((move = NextMoveQ(sd, alpha)) != M_NONE) {
         DoMove(p, move);
+        PrefetchChild(p, false);
         if (InCheck(p, OPP(p->turn)))
             UndoMove(p, move);
         else {
@@ -593,6 +679,9 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
     int reduce_extensions;
     int next_type;
     bool was_futile = false;
+#if MP
+    bool in_flight = false;
+#endif
 #if FUTILITY
     int is_futile;
     int optimistic = 0;
@@ -601,7 +690,6 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
     EnterNode(sd);
 
     sd->nodes_cnt++;
-    TotalNodes++;
 
     /* check for search termination */
     if (sd->master && TerminateSearch(sd)) {
@@ -628,8 +716,8 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
 
     incheck = InCheck(p, p->turn);
     if (incheck && p->material[p->turn] > 0) {
-        extend += CheckExtend(p);
-        ChkExt++;
+        extend += CheckExtend(sd);
+        sd->stats.ss_ChkExt++;
     }
 
     /*
@@ -637,29 +725,33 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
      */
 
     st = sd->current;
+    st->st_depth = depth;
 
-    HTry++;
-#if MP
-    switch (ProbeHT(p->hkey, &tmp, depth, &(st->st_hashmove), &threat, sd->ply,
-                    exclusiveP, sd->localHashTable))
-#else
-    switch (ProbeHT(p->hkey, &tmp, depth, &(st->st_hashmove), &threat, sd->ply))
-#endif /* MP */
-    {
+    sd->stats.ss_HTry++;
+    CountHT(HS_Probes, depth);
+    LookupResult probe =
+        ProbeHT(p->hkey, &tmp, depth, &(st->st_hashmove), &threat, sd->ply);
+    if (probe != Useless)
+        CountHT(HS_Hits, depth);
+
+    switch (probe) {
     case ExactScore:
-        HHit++;
+        sd->stats.ss_HHit++;
+        CountHT(HS_ExactCutoffs, depth);
         best = tmp;
         goto EXIT;
     case UpperBound:
         if (tmp <= alpha) {
-            HHit++;
+            sd->stats.ss_HHit++;
+            CountHT(HS_UpperCutoffs, depth);
             best = tmp;
             goto EXIT;
         }
         break;
     case LowerBound:
         if (tmp >= beta) {
-            HHit++;
+            sd->stats.ss_HHit++;
+            CountHT(HS_LowerCutoffs, depth);
             best = tmp;
             goto EXIT;
         }
@@ -667,15 +759,30 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
     case Useless:
         threat = !incheck && MateThreat(p, OPP(p->turn));
         break;
-#if MP
-    case OnEvaluation:
-        best = -ON_EVALUATION;
-        goto EXIT;
-#endif
     default:
         break;
     }
 
+#if MP
+    /*
+     * ABDADA: defer this node if another thread is searching it already,
+     * otherwise announce that we are searching it.
+     */
+
+    if (NumberOfCPUs > 1 && ParallelMode == SMP_ABDADA) {
+        switch (EnterInFlight(p->hkey, depth, exclusiveP)) {
+        case IF_BUSY:
+            best = -ON_EVALUATION;
+            goto EXIT;
+        case IF_ENTERED:
+            in_flight = true;
+            break;
+        case IF_UNTRACKED:
+            break;
+        }
+    }
+#endif /* MP */
+
     /*
      * Probe EGTB
      */
@@ -761,7 +868,7 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
                     goto EXIT;
                 } else {
                     extend += ExtendZugzwang;
-                    ZZExt++;
+                    sd->stats.ss_ZZExt++;
                 }
             }
         } else if (nms <= -CMLIMIT) {
@@ -830,7 +937,7 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
         if ((move & M_CAPTURE) && (lmove & M_CAPTURE) &&
             M_TO(move) == M_TO(lmove) &&
             IsRecapture(p->piece[M_TO(move)], (p->actLog - 1)->gl_Piece)) {
-            RCExt += 1;
+            sd->stats.ss_RCExt++;
             next_depth += ExtendRecapture[TYPE(p->piece[M_TO(move)])];
         }
 
@@ -847,7 +954,7 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
                  (p->turn == Black && to <= h2)) &&
                 IsPassed(p, to, p->turn) && SwapOff(p, move) >= 0) {
                 next_depth += ExtendPassedPawn;
-                PPExt += 1;
+                sd->stats.ss_PPExt++;
             }
         }
 
@@ -913,6 +1020,7 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
 #endif /* FUTILITY */
 
         DoMove(p, move);
+        PrefetchChild(p, true);
         if (InCheck(p, OPP(p->turn))) {
             UndoMove(p, move);
         } else {
@@ -1089,6 +1197,12 @@ static int negascout(struct SearchData *sd, int alpha, int beta,
 
 EXIT:
 
+#if MP
+    if (in_flight) {
+        LeaveInFlight(p->hkey, depth);
+    }
+#endif
+
     if (node_type == PVNode) {
         sd->pv_save[sd->ply] = bestm;
     }
@@ -1122,13 +1236,8 @@ static void AnaLoop(struct Position *p, int depth) {
     bool dummy = false;
     int score;
 
-#if MP
-    if (ProbeHT(p->hkey, &score, 0, &move, &dummy, 0, 0, NULL) == Useless)
-        return;
-#else
     if (ProbeHT(p->hkey, &score, 0, &move, &dummy, 0) == Useless)
         return;
-#endif
 
     if (Repeated(p, true) >= 2)
         return;
@@ -1191,16 +1300,107 @@ static void AnalyzeHT(struct Position *p, move_t move) {
 static void InitSearch(struct SearchData *sd) {
     sd->ply = 0;
     sd->nodes_cnt = sd->qnodes_cnt = sd->check_nodes_cnt = 0;
-    RCExt = ChkExt = DiscExt = DblExt = SingExt = PPExt = ZZExt = 0;
+}
+
+/**
+ * Reset the search state shared by all search threads. Done once per search
+ * before any helper thread is started.
+ */
+static void InitSearchStatistics(void) {
     PrintOK = (SearchMode == Analyzing) ? true : false;
     DoneAtRoot = false;
-    EGTBProbe = EGTBProbeSucc = 0;
 
-    /* Initialize scoring tables */
+    for (int i = 0; i < MAX_TREE_SIZE; i++) {
+        DepthTime[i] = -1;
+    }
+}
+
+/**
+ * Search position 'p' to 'depth' plies, independent of the clock and of the
+ * depth and node limits set. Returns the best move and the number of nodes
+ * searched in 'nodes'.
+ */
+int SearchToDepth(struct Position *p, int depth, unsigned long *nodes) {
+    const int depth_limit = DepthLimit;
+    const unsigned long node_limit = NodeLimit;
+    const int multi_pv = MultiPV;
+
+    SearchMode = Searching;
+    DepthLimit = depth;
+    NodeLimit = 0;
+    MultiPV = 1;
+    SearchNodes = 0;
+
+    int move = Iterate(p);
+
+    DepthLimit = depth_limit;
+    NodeLimit = node_limit;
+    MultiPV = multi_pv;
+    *nodes = SearchNodes;
+
+    return move;
+}
 
-    HTry = HHit = PTry = PHit = STry = SHit = 0;
+/**
+ * Return the time after which the last search completed iteration 'depth',
+ * or -1 if it did not.
+ */
+int SearchDepthTime(int depth) {
+    if (depth < 0 || depth >= MAX_TREE_SIZE)
+        return -1;
+
+    return DepthTime[depth];
 }
 
+#if MP
+
+/**
+ * Return the name of a parallel search algorithm.
+ */
+const char *ParallelModeName(smp_mode_t mode) {
+    return ParallelModeNames[mode];
+}
+
+/**
+ * Parse the name of a parallel search algorithm. Returns false if 'name'
+ * is unknown.
+ */
+bool ParseParallelMode(const char *name, smp_mode_t *mode) {
+    for (int i = 0; i < 2; i++) {
+        if (!strcmp(name, ParallelModeNames[i])) {
+            *mode = (smp_mode_t)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Lazy SMP: let each helper start with a different root move after the
+ * first one, so the helpers fill the transposition table with different
+ * subtrees.
+ */
+static void DiversifyRootMoves(struct SearchData *sd, move_t *mvs) {
+    int cnt = sd->nrootmoves - 1;
+    int shift;
+    move_t tmp[256];
+
+    if (cnt < 2)
+        return;
+
+    shift = sd->thread_id % cnt;
+    if (shift == 0)
+        return;
+
+    for (int i = 0; i < cnt; i++) {
+        tmp[i] = mvs[1 + (i + shift) % cnt];
+    }
+    memcpy(mvs + 1, tmp, cnt * sizeof(move_t));
+}
+
+#endif /* MP */
+
 // Marcin Ciura's gap sequence for shell sort
 static int gaps[] = {57, 23, 10, 4, 1};
 
@@ -1235,6 +1435,147 @@ static void ResortMovesList(int cnt, move_t *mvs, unsigned long *nodes) {
     }
 }
 
+/**
+ * Search a single root move with window [alpha, beta].
+ */
+static int SearchRootMove(struct SearchData *sd, move_t move, int alpha,
+                          int beta, int node_type) {
+    struct Position *p = sd->position;
+    int next_depth = (sd->depth - 2) * OnePly;
+    int score;
+
+    DoMove(p, move);
+    if (InCheck(p, p->turn))
+        next_depth += ExtendInCheck;
+
+    if (next_depth >= 0) {
+#if MP
+        score = -negascout(sd, -beta, -alpha, next_depth, node_type, 0);
+#else
+        score = -negascout(sd, -beta, -alpha, next_depth, node_type);
+#endif
+    } else {
+        score = -quies(sd, -beta, -alpha, 0);
+    }
+    UndoMove(p, move);
+
+    return score;
+}
+
+/**
+ * One iteration of the multi-PV root search. The best 'lines' root moves
+ * are kept in mvs[0..lines-1], sorted by their scores in 'scores'. They are
+ * searched with an open window, all other moves with a null window on the
+ * worst of these scores and re-searched if they fail high. The master keeps
+ * the principal variations in MultiPVLine. Returns the best score.
+ */
+static int SearchMultiPV(struct SearchData *sd, move_t *mvs,
+                         unsigned long *nodes, int *scores, int lines) {
+    struct Position *p = sd->position;
+
+    for (sd->movenum = 0; sd->movenum < sd->nrootmoves; sd->movenum++) {
+        move_t move = mvs[sd->movenum];
+        int alpha = -INF;
+        int score;
+
+        nodes[sd->movenum] = sd->nodes_cnt;
+
+        if (sd->master && PrintOK) {
+            char time_buffer[16];
+            char san_buffer[32];
+
+            PrintNoLog(2, "%2d  %s   %2d/%2d  %s      \r", sd->depth,
+                       FormatTime(CurTime - StartTime, time_buffer,
+                                  sizeof(time_buffer)),
+                       sd->movenum + 1, sd->nrootmoves,
+                       NumberedSAN(p, move, san_buffer, sizeof(san_buffer)));
+        }
+
+        if (sd->movenum < lines) {
+            score = SearchRootMove(sd, move, -INF, INF, PVNode);
+        } else {
+            alpha = scores[lines - 1];
+            score = SearchRootMove(sd, move, alpha, alpha + 1, CutNode);
+            if (score > alpha && !AbortSearch)
+                score = SearchRootMove(sd, move, alpha, INF, PVNode);
+        }
+        nodes[sd->movenum] = sd->nodes_cnt - nodes[sd->movenum];
+
+        if (AbortSearch)
+            break;
+
+        if (score > alpha) {
+            /*
+             * Insert the move into the list of lines, the move with the
+             * lowest score drops out of it.
+             */
+
+            int last = (sd->movenum < lines) ? sd->movenum : lines - 1;
+            unsigned long move_nodes = nodes[sd->movenum];
+            int i;
+
+            for (i = last; i > 0 && scores[i - 1] < score; i--)
+                ;
+
+            memmove(mvs + i + 1, mvs + i, (sd->movenum - i) * sizeof(move_t));
+            memmove(nodes + i + 1, nodes + i,
+                    (sd->movenum - i) * sizeof(unsigned long));
+            memmove(scores + i + 1, scores + i, (last - i) * sizeof(int));
+            mvs[i] = move;
+            nodes[i] = move_nodes;
+            scores[i] = score;
+
+            if (sd->master) {
+                move_t pb_move = PBMove;
+
+                memmove(MultiPVLine[i + 1], MultiPVLine[i],
+                        (last - i) * sizeof(MultiPVLine[0]));
+                AnalyzeHT(p, move);
+                strcpy(MultiPVLine[i], BestLine);
+                if (i != 0)
+                    PBMove = pb_move;
+            }
+        }
+
+        if (sd->master && sd->movenum == 0 && CurTime > SoftLimit) {
+            if (SearchMode == Searching) {
+                AbortSearch = true;
+                break;
+            } else if (SearchMode == Pondering) {
+                DoneAtRoot = true;
+            }
+        }
+    }
+
+    return scores[0];
+}
+
+/**
+ * Print the lines of the last completed multi-PV iteration.
+ */
+static void MultiPVOutput(int time, unsigned long nodes) {
+    for (int i = 0; i < MultiPVCount; i++) {
+        int score = MultiPVScore[i];
+
+        SearchOutput(MultiPVDepth, time, (MultiPVTurn) ? -score : score,
+                     MultiPVResult[i], nodes);
+    }
+}
+
+/**
+ * Show the principal variations found by the last multi-PV search.
+ */
+void ShowMultiPV(void) {
+    for (int i = 0; i < MultiPVCount; i++) {
+        char score_as_text[16];
+
+        Print(0, "%2d: (%7s) %s\n", i + 1,
+              FormatScore(MultiPVScore[i], score_as_text,
+                          sizeof(score_as_text)),
+              MultiPVResult[i]);
+    }
+}
+
 /*
  * This routine searches a chess position. It uses iterative deepening,
  * aspiration window and scout search.
@@ -1243,6 +1584,8 @@ static void ResortMovesList(int cnt, move_t *mvs, unsigned long *nodes) {
 static void *IterateInt(void *x) {
     int best;
     unsigned long nodes[256];
+    int scores[MAX_MULTI_PV];
+    int lines;
     int last = 0;
     double elapsed;
     struct SearchData *sd = x;
@@ -1250,11 +1593,13 @@ static void *IterateInt(void *x) {
     bool any_pv_printed = false;
     bool pv_valid = false;
 
-    if (!sd->master) {
-        usleep(50 + 100 * Random());
-    }
     p = sd->position;
 
+#if MP && HAVE_LIBPTHREAD
+    UseEvalCache(sd->evalCache);
+#endif /* MP && HAVE_LIBPTHREAD */
+    UseSearchStats(&sd->stats);
+
     InitSearch(sd);
     sd->nrootmoves = LegalMoves(p, sd->heap);
 
@@ -1265,15 +1610,61 @@ static void *IterateInt(void *x) {
     if (!(mvs[0] & M_TACTICAL))
         PutKiller(sd, mvs[0]);
 
+    lines = (MultiPV < sd->nrootmoves) ? MultiPV : sd->nrootmoves;
+    if (sd->master) {
+        MultiPVCount = 0;
+    }
+
     MaxDepth = MAX_TREE_SIZE - 1;
 
-    for (sd->depth = 1; sd->depth < MaxSearchDepth; sd->depth++) {
+    int first_depth = 1;
+#if MP
+    /*
+     * Lazy SMP: every other helper searches one ply deeper than the master.
+     */
+    if (ParallelMode == SMP_LAZY && !sd->master) {
+        first_depth += sd->thread_id & 1;
+    }
+#endif /* MP */
+
+    for (sd->depth = first_depth; sd->depth < MaxSearchDepth; sd->depth++) {
         int alpha = best - PVWindow;
         int beta = best + PVWindow;
         bool is_pv = true;
         bool pv_stable = true;
+        int first_move = 0;
 
-        for (sd->movenum = 0; sd->movenum < sd->nrootmoves; sd->movenum++) {
+#if MP
+        if (ParallelMode == SMP_LAZY && !sd->master) {
+            DiversifyRootMoves(sd, mvs);
+        }
+#endif /* MP */
+
+        if (lines > 1) {
+            move_t last_best = mvs[0];
+
+            best = SearchMultiPV(sd, mvs, nodes, scores, lines);
+            if (AbortSearch)
+                goto final;
+
+            pv_stable = (mvs[0] == last_best);
+            if (sd->master) {
+                memcpy(MultiPVResult, MultiPVLine,
+                       lines * sizeof(MultiPVLine[0]));
+                memcpy(MultiPVScore, scores, lines * sizeof(int));
+                MultiPVCount = lines;
+                MultiPVDepth = sd->depth;
+                MultiPVTurn = p->turn;
+                strcpy(BestLine, MultiPVLine[0]);
+                pv_valid = true;
+            }
+
+            /* all root moves have been searched */
+            first_move = sd->nrootmoves;
+        }
+
+        for (sd->movenum = first_move; sd->movenum < sd->nrootmoves;
+             sd->movenum++) {
             int tmp;
             int next_depth = (sd->depth - 2) * OnePly;
             move_t move = mvs[sd->movenum];
@@ -1486,11 +1877,20 @@ static void *IterateInt(void *x) {
             }
         }
 
+        if (sd->master) {
+            DepthTime[sd->depth] = GetTime() - StartTime;
+        }
+
         if (sd->master && (PrintOK || (sd->depth > MateDepth &&
                                        (best < -CMLIMIT || best > CMLIMIT)))) {
-            SearchOutput(sd->depth, CurTime - StartTime,
-                         (p->turn) ? -best : best, BestLine,
-                         sd->nodes_cnt + sd->qnodes_cnt);
+            if (lines > 1) {
+                MultiPVOutput(CurTime - StartTime,
+                              sd->nodes_cnt + sd->qnodes_cnt);
+            } else {
+                SearchOutput(sd->depth, CurTime - StartTime,
+                             (p->turn) ? -best : best, BestLine,
+                             sd->nodes_cnt + sd->qnodes_cnt);
+            }
 
             any_pv_printed = true;
         }
@@ -1509,7 +1909,8 @@ static void *IterateInt(void *x) {
         }
 
         NeedTime = false;
-        ResortMovesList(sd->nrootmoves, mvs, nodes);
+        ResortMovesList(sd->nrootmoves - lines + 1, mvs + lines - 1,
+                        nodes + lines - 1);
 
         /*
             if(Depth > 5 && pv_stable) {
@@ -1535,18 +1936,8 @@ static void *IterateInt(void *x) {
 
         CurTime = GetTime();
 
-        if (sd->depth > 3) {
-            /*
-             * Do ten checks per second.
-             */
-
-            elapsed = (double)(CurTime - StartTime) / (double)ONE_SECOND;
-
-            NodesPerCheck =
-                (elapsed == 0.0)
-                    ? 1000
-                    : (int)((sd->nodes_cnt + sd->qnodes_cnt) / elapsed / 10);
-        }
+        if (sd->depth > 3)
+            SetNodesPerCheck(sd);
 
         if (SearchMode == Puzzling && sd->depth > 4)
             break;
@@ -1571,124 +1962,317 @@ final:
     if (sd->master) {
         if (pv_valid && !any_pv_printed) {
             // Make sure there is a PV printed
-            SearchOutput(sd->depth, CurTime - StartTime,
-                         (p->turn) ? -best : best, BestLine,
-                         sd->nodes_cnt + sd->qnodes_cnt);
+            if (lines > 1) {
+                MultiPVOutput(CurTime - StartTime,
+                              sd->nodes_cnt + sd->qnodes_cnt);
+            } else {
+                SearchOutput(sd->depth, CurTime - StartTime,
+                             (p->turn) ? -best : best, BestLine,
+                             sd->nodes_cnt + sd->qnodes_cnt);
+            }
         }
 
         char buf1[16], buf2[16], buf3[16], buf4[16], buf5[16], buf6[16],
             buf7[16];
+        struct SearchStats s;
 
-        unsigned long nps = (unsigned long)(TotalNodes / elapsed);
+        unsigned long total_nodes = SumSearchStats(sd, &s);
+        unsigned long nps = (unsigned long)(total_nodes / elapsed);
 
         Print(2, "Nodes = %s, QPerc: %d %%, time = %g secs, %s nodes/s\n",
-              FormatCount(TotalNodes, buf1, sizeof(buf1)),
+              FormatCount(total_nodes, buf1, sizeof(buf1)),
               Percentage(sd->qnodes_cnt, sd->nodes_cnt + sd->qnodes_cnt),
               elapsed, FormatCount(nps, buf2, sizeof(buf2)));
 
         Print(2,
               "Extensions: Check: %s  DblChk: %s  DiscChk: %s  SingReply: %s\n"
               "            Recapture: %s   Passed Pawn: %s   Zugzwang: %s\n",
-              FormatCount(ChkExt, buf1, sizeof(buf1)),
-              FormatCount(DblExt, buf2, sizeof(buf2)),
-              FormatCount(DiscExt, buf3, sizeof(buf3)),
-              FormatCount(SingExt, buf4, sizeof(buf4)),
-              FormatCount(RCExt, buf5, sizeof(buf5)),
-              FormatCount(PPExt, buf6, sizeof(buf6)),
-              FormatCount(ZZExt, buf7, sizeof(buf7)));
+              FormatCount(s.ss_ChkExt, buf1, sizeof(buf1)),
+              FormatCount(s.ss_DblExt, buf2, sizeof(buf2)),
+              FormatCount(s.ss_DiscExt, buf3, sizeof(buf3)),
+              FormatCount(s.ss_SingExt, buf4, sizeof(buf4)),
+              FormatCount(s.ss_RCExt, buf5, sizeof(buf5)),
+              FormatCount(s.ss_PPExt, buf6, sizeof(buf6)),
+              FormatCount(s.ss_ZZExt, buf7, sizeof(buf7)));
 
         Print(2,
               "Hashing: Trans: %s/%s = %d %%   Pawn: %s/%s = %d %%\n"
-              "         Eval: %s/%s = %d %%\n",
-              FormatCount(HHit, buf1, sizeof(buf1)),
-              FormatCount(HTry, buf2, sizeof(buf2)), Percentage(HHit, HTry),
-              FormatCount(PHit, buf3, sizeof(buf3)),
-              FormatCount(PTry, buf4, sizeof(buf4)), Percentage(PHit, PTry),
-              FormatCount(SHit, buf5, sizeof(buf5)),
-              FormatCount(STry, buf6, sizeof(buf6)), Percentage(SHit, STry));
-
-        if (EGTBProbe != 0) {
+              "         Eval: %s/%s = %d %%   Illegal moves: %s\n",
+              FormatCount(s.ss_HHit, buf1, sizeof(buf1)),
+              FormatCount(s.ss_HTry, buf2, sizeof(buf2)),
+              Percentage(s.ss_HHit, s.ss_HTry),
+              FormatCount(s.ss_PHit, buf3, sizeof(buf3)),
+              FormatCount(s.ss_PTry, buf4, sizeof(buf4)),
+              Percentage(s.ss_PHit, s.ss_PTry),
+              FormatCount(s.ss_SHit, buf5, sizeof(buf5)),
+              FormatCount(s.ss_STry, buf6, sizeof(buf6)),
+              Percentage(s.ss_SHit, s.ss_STry),
+              FormatCount(s.ss_HIllegal, buf7, sizeof(buf7)));
+
+        if (s.ss_EGTBProbe != 0) {
             Print(2, "EGTB Hits/Probes = %s/%s\n",
-                  FormatCount(EGTBProbeSucc, buf1, sizeof(buf1)),
-                  FormatCount(EGTBProbe, buf2, sizeof(buf2)));
+                  FormatCount(s.ss_EGTBProbeSucc, buf1, sizeof(buf1)),
+                  FormatCount(s.ss_EGTBProbe, buf2, sizeof(buf2)));
         }
-
-        ShowHashStatistics();
     }
 
     sd->best_move = mvs[0];
 
-    if (!sd->master) {
+#if MP && HAVE_LIBPTHREAD
+    UseEvalCache(NULL);
+#endif /* MP && HAVE_LIBPTHREAD */
+    UseSearchStats(NULL);
+
+    return NULL;
+}
+
+#if MP
+
+#if HAVE_LIBPTHREAD
+
+/*
+ * The helper threads are started once and wait on HelperWake between
+ * searches. Each helper keeps its SearchData, which is reset for every
+ * search, and gets a copy of the root position.
+ */
+struct Helper {
+    pthread_t h_Thread;
+    struct SearchData *h_SearchData;
+    unsigned int h_Search; /* the last search started */
+};
+
+static struct Helper *Helpers = NULL;
+static int HelperCount = 0;
+static pthread_mutex_t HelperMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t HelperWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t HelperDone = PTHREAD_COND_INITIALIZER;
+static unsigned int HelperSearch = 0; /* incremented to start a search */
+static int HelpersSearching = 0;
+static bool HelpersExit = false;
+
+/*
+ * A job the helpers run instead of a search, see RunOnHelpers(). Helper i
+ * runs slice i + 1 if there is one.
+ */
+static void (*HelperJob)(void *, int) = NULL;
+static void *HelperJobArg = NULL;
+static int HelperJobSlices = 0;
+
+static void *HelperLoop(void *x) {
+    struct Helper *h = x;
+
+    pthread_mutex_lock(&HelperMutex);
+    for (;;) {
+        while (HelperSearch == h->h_Search && !HelpersExit) {
+            pthread_cond_wait(&HelperWake, &HelperMutex);
+        }
+        if (HelpersExit)
+            break;
+        h->h_Search = HelperSearch;
+
+        void (*job)(void *, int) = HelperJob;
+        void *arg = HelperJobArg;
+        int slice = (int)(h - Helpers) + 1;
+        bool has_slice = slice < HelperJobSlices;
+        pthread_mutex_unlock(&HelperMutex);
+
+        if (job != NULL) {
+            if (has_slice)
+                job(arg, slice);
+        } else {
+            IterateInt(h->h_SearchData);
+        }
+
+        pthread_mutex_lock(&HelperMutex);
+        if (--HelpersSearching == 0) {
+            pthread_cond_signal(&HelperDone);
+        }
+    }
+    pthread_mutex_unlock(&HelperMutex);
+
+    return NULL;
+}
+
+/*
+ * Terminate all helper threads.
+ */
+
+static void ExitHelpers(void) {
+    if (Helpers == NULL)
+        return;
+
+    pthread_mutex_lock(&HelperMutex);
+    HelpersExit = true;
+    pthread_cond_broadcast(&HelperWake);
+    pthread_mutex_unlock(&HelperMutex);
+
+    for (int i = 0; i < HelperCount; i++) {
+        struct SearchData *sd = Helpers[i].h_SearchData;
+
+        pthread_join(Helpers[i].h_Thread, NULL);
         FreePosition(sd->position);
         FreeSearchData(sd);
     }
 
-    return NULL;
+    free(Helpers);
+    Helpers = NULL;
+    HelperCount = 0;
+    HelpersExit = false;
 }
 
-#if MP && HAVE_LIBPTHREAD
-pthread_t *tids = NULL;
-#endif /* MP && HAVE_LIBPTHREAD */
+/*
+ * Start NumberOfCPUs - 1 helper threads, unless they are running already.
+ */
 
-#if MP
+static void CreateHelpers(void) {
+    pthread_attr_t attr;
+
+    if (Helpers != NULL && HelperCount == NumberOfCPUs - 1)
+        return;
+
+    ExitHelpers();
+
+    Helpers = calloc(NumberOfCPUs - 1, sizeof(struct Helper));
+    if (Helpers == NULL) {
+        Print(0, "Cannot allocate memory for helpers.\n");
+        Print(0, "Will try to search sequential.\n");
+        return;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+    for (int i = 0; i < NumberOfCPUs - 1; i++) {
+        struct Helper *h = Helpers + i;
+
+        h->h_SearchData = CreateSearchData(NULL);
+        h->h_SearchData->master = false;
+        h->h_SearchData->thread_id = i + 1;
+        h->h_Search = HelperSearch;
+        if (pthread_create(&h->h_Thread, &attr, &HelperLoop, h) != 0) {
+            FreeSearchData(h->h_SearchData);
+            break;
+        }
+        HelperCount++;
+    }
+
+    pthread_attr_destroy(&attr);
+}
+
+#endif /* HAVE_LIBPTHREAD */
 
 /*
- * In parallel search stop all helper threads
+ * In parallel search stop all helper threads. They wait for the next
+ * search.
  */
 
 void StopHelpers(void) {
 #if HAVE_LIBPTHREAD
-    if (tids) {
-        int nthread;
-        void *dummy;
-
+    pthread_mutex_lock(&HelperMutex);
+    if (HelpersSearching > 0) {
         AbortSearch = true;
-        for (nthread = 0; nthread < (NumberOfCPUs - 1); nthread++) {
-            pthread_join(tids[nthread], &dummy);
+        while (HelpersSearching > 0) {
+            pthread_cond_wait(&HelperDone, &HelperMutex);
         }
-        free(tids);
-        tids = NULL;
     }
+    pthread_mutex_unlock(&HelperMutex);
 #endif /* HAVE_LIBPTHREAD */
 }
 
 /*
- * In parallel search start up all helper threads
+ * Forget the helper threads in a process created by fork(), they only exist
+ * in the parent process.
  */
 
-static void StartHelpers(struct Position *p) {
+void ForgetHelpers(void) {
 #if HAVE_LIBPTHREAD
-    pthread_attr_t attr;
-    int nthread;
+    Helpers = NULL;
+    HelperCount = 0;
+    HelpersSearching = 0;
+#endif /* HAVE_LIBPTHREAD */
+}
 
-    if (tids) {
-        StopHelpers();
+/**
+ * Run job(arg, slice) for the slices 1 ... nslices - 1 on the helper
+ * threads while the calling thread runs slice 0, and wait for all of them.
+ * The helpers are started if they are not running yet. Returns false
+ * without running anything if the helpers are searching or if there are
+ * fewer than nslices - 1 of them.
+ */
+bool RunOnHelpers(void (*job)(void *, int), void *arg, int nslices) {
+#if HAVE_LIBPTHREAD
+    bool busy;
+
+    if (nslices < 2 || nslices > NumberOfCPUs)
+        return false;
+
+    pthread_mutex_lock(&HelperMutex);
+    busy = HelpersSearching > 0;
+    pthread_mutex_unlock(&HelperMutex);
+    if (busy)
+        return false;
+
+    CreateHelpers();
+    if (HelperCount < nslices - 1)
+        return false;
+
+    pthread_mutex_lock(&HelperMutex);
+    HelperJob = job;
+    HelperJobArg = arg;
+    HelperJobSlices = nslices;
+    HelpersSearching = HelperCount;
+    HelperSearch++;
+    pthread_cond_broadcast(&HelperWake);
+    pthread_mutex_unlock(&HelperMutex);
+
+    job(arg, 0);
+
+    pthread_mutex_lock(&HelperMutex);
+    while (HelpersSearching > 0) {
+        pthread_cond_wait(&HelperDone, &HelperMutex);
     }
+    HelperJob = NULL;
+    HelperJobArg = NULL;
+    HelperJobSlices = 0;
+    pthread_mutex_unlock(&HelperMutex);
 
-    if (NumberOfCPUs < 2)
-        return;
+    return true;
+#else
+    (void)job;
+    (void)arg;
+    (void)nslices;
+    return false;
+#endif /* HAVE_LIBPTHREAD */
+}
 
-    tids = calloc(NumberOfCPUs - 1, sizeof(pthread_t));
+/*
+ * In parallel search let the helper threads search position 'p'.
+ */
 
-    if (tids == NULL) {
-        Print(0, "Cannot allocate memory for helpers.\n");
-        Print(0, "Will try to search sequential.\n");
+static void StartHelpers(struct Position *p) {
+#if HAVE_LIBPTHREAD
+    StopHelpers();
+
+    if (NumberOfCPUs < 2) {
+        ExitHelpers();
         return;
     }
 
-    pthread_attr_init(&attr);
-    pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+    CreateHelpers();
 
-    /*
-     * Start up the helper threads.
-     */
+    for (int i = 0; i < HelperCount; i++) {
+        struct SearchData *sd = Helpers[i].h_SearchData;
 
-    for (nthread = 0; nthread < (NumberOfCPUs - 1); nthread++) {
-        struct SearchData *sd = CreateSearchData(ClonePosition(p));
-        sd->master = false;
-        pthread_create(tids + nthread, &attr, &IterateInt, sd);
+        FreePosition(sd->position);
+        ResetSearchData(sd, ClonePosition(p));
+        sd->evalCache = GetEvalCache(i + 1);
     }
 
+    pthread_mutex_lock(&HelperMutex);
+    HelpersSearching = HelperCount;
+    HelperSearch++;
+    pthread_cond_broadcast(&HelperWake);
+    pthread_mutex_unlock(&HelperMutex);
 #endif /* HAVE_LIBPTHREAD */
 }
 
@@ -1716,7 +2300,7 @@ int Iterate(struct Position *p) {
     AbortSearch = false;
     NeedTime = false;
 
-    TotalNodes = 0;
+    InitSearchStatistics();
 
     /*
      * Check if we need to start searching at all
@@ -1738,9 +2322,27 @@ int Iterate(struct Position *p) {
 
     free_heap(heap);
 
-    SoftLimit = StartTime + (int)(soft * ONE_SECOND);
-    SoftLimit2 = StartTime + (int)(85 * soft);
-    HardLimit = StartTime + (int)(hard * ONE_SECOND);
+    /*
+     * Depth and node limits replace the clock when searching for a move.
+     * Analysis and pondering go on until interrupted.
+     */
+
+    bool limited = (DepthLimit > 0 || NodeLimit > 0) &&
+                   (SearchMode == Searching || SearchMode == Puzzling);
+
+    MaxSearchDepth = (limited && DepthLimit > 0) ? DepthLimit + 1
+                                                  : MAX_TREE_SIZE - 1;
+    SearchNodeLimit = limited ? NodeLimit : 0;
+
+    if (limited) {
+        SoftLimit = SoftLimit2 = HardLimit = UINT_MAX;
+    } else {
+        SoftLimit = StartTime + (int)(soft * ONE_SECOND);
+        SoftLimit2 = StartTime + (int)(0.85 * soft * ONE_SECOND);
+        HardLimit = StartTime + (int)(hard * ONE_SECOND);
+    }
+
+    NodesPerCheck = NODES_PER_CHECK_MIN;
 
     InitEvaluation(p);
     AgeHashTable();
@@ -1752,18 +2354,54 @@ int Iterate(struct Position *p) {
 
     sd = CreateSearchData(p);
     sd->master = true;
+#if MP && HAVE_LIBPTHREAD
+    sd->evalCache = GetEvalCache(0);
+#endif /* MP && HAVE_LIBPTHREAD */
     IterateInt(sd);
 
     move_t best_move = sd->best_move;
-    FreeSearchData(sd);
 
 #if MP
     StopHelpers();
 #endif /* MP */
 
+    struct SearchStats stats;
+    SearchNodes = SumSearchStats(sd, &stats);
+    AddHTStatistics(&stats);
+    FreeSearchData(sd);
+
+    ShowHashStatistics();
+
     return best_move;
 }
 
+/**
+ * Sum up the statistics of the master 'sd' and all helper threads in 'sum'
+ * unless it is NULL. Returns the number of nodes searched by all threads.
+ */
+static unsigned long SumSearchStats(struct SearchData *sd,
+                                    struct SearchStats *sum) {
+    unsigned long nodes = sd->nodes_cnt + sd->qnodes_cnt;
+
+    if (sum != NULL) {
+        memset(sum, 0, sizeof(*sum));
+        AddSearchStats(sum, &sd->stats);
+    }
+
+#if MP && HAVE_LIBPTHREAD
+    for (int i = 0; i < HelperCount; i++) {
+        const struct SearchData *helper = Helpers[i].h_SearchData;
+
+        nodes += helper->nodes_cnt + helper->qnodes_cnt;
+        if (sum != NULL) {
+            AddSearchStats(sum, &helper->stats);
+        }
+    }
+#endif /* MP && HAVE_LIBPTHREAD */
+
+    return nodes;
+}
+
 /**
  * Search the root node.
  */
@@ -1794,8 +2432,7 @@ void SearchRoot(struct Position *p) {
     }
 
     if (move != M_NONE) {
-        double elapsed = (double)(CurTime - StartTime) / (double)ONE_SECOND;
-        DoTC(p, (int)(elapsed + 0.5));
+        DoTC(p, GetTime() - StartTime);
 
         char san_buffer[16];
         Print(0, REVERSE "%s(%d): %s" NORMAL "\n",
@@ -1887,7 +2524,7 @@ pb_result_t PermanentBrain(struct Position *p) {
                   (p->ply / 2) + 1, SAN(p, PBActMove, san_buffer));
 
             DoMove(p, PBActMove);
-            DoTC(p, (int)(elapsed + 0.5));
+            DoTC(p, GetTime() - WallTimeStart);
 
             Print(0, REVERSE "%s(%d): %s" NORMAL "\n",
                   p->turn == White ? "White" : "Black", (p->ply / 2) + 1,
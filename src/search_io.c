@@ -101,8 +101,8 @@ void SearchOutput(int depth, int time, int score, char *line, int nodes) {
                 }
                 short_line[idx] = '\0';
             }
-            PrintNoLog(0, "%d %d %d %d %s\n", depth, s, time, nodes,
-                       short_line);
+            PrintNoLog(0, "%d %d %d %d %s\n", depth, s, CENTISECONDS(time),
+                       nodes, short_line);
             free(short_line);
         }
     }
@@ -116,13 +116,15 @@ void SearchOutputFailHighLow(int depth, int time, int isfailhigh, char *move,
         Print(1, "%2d  %s     +++  %s\n", depth,
               FormatTime(time, time_as_text, sizeof(time_as_text)), move);
         if (PostMode) {
-            PrintNoLog(0, "%d 0 %d %d %s!\n", depth, time, nodes, move);
+            PrintNoLog(0, "%d 0 %d %d %s!\n", depth, CENTISECONDS(time), nodes,
+                       move);
         }
     } else {
         Print(1, "%2d  %s     ---  %s\n", depth,
               FormatTime(time, time_as_text, sizeof(time_as_text)), move);
         if (PostMode) {
-            PrintNoLog(0, "%d 0 %d %d %s?\n", depth, time, nodes, move);
+            PrintNoLog(0, "%d 0 %d %d %s?\n", depth, CENTISECONDS(time), nodes,
+                       move);
         }
     }
 }
@@ -50,4 +50,37 @@ static void test_parse_san_promotions(void) {
     FreePosition(p);
 }
 
-void test_all_dbase(void) { test_parse_san_promotions(); }
+static void test_material_key(void) {
+    struct Position *p =
+        CreatePositionFromEPD("1r2k3/P7/8/8/8/2b5/8/R3K2B w - -");
+    struct Position *q =
+        CreatePositionFromEPD("1B2k3/8/8/8/8/2b5/8/R3K2B b - -");
+    hash_t key = p->mkey;
+
+    move_t move = make_promotion(a7, b8, Bishop, M_CAPTURE);
+    assert(LegalMove(p, move));
+    DoMove(p, move);
+    assert(p->mkey == q->mkey);
+    UndoMove(p, move);
+    assert(p->mkey == key);
+
+    FreePosition(p);
+    FreePosition(q);
+
+    /* Bishops on a1 and c1 are on the same color, b1 is not. */
+    p = CreatePositionFromEPD("4k3/8/8/8/8/8/8/B3K3 w - -");
+    q = CreatePositionFromEPD("4k3/8/8/8/8/8/8/2B1K3 w - -");
+    assert(p->mkey == q->mkey);
+    FreePosition(q);
+
+    q = CreatePositionFromEPD("4k3/8/8/8/8/8/8/1B2K3 w - -");
+    assert(p->mkey != q->mkey);
+    FreePosition(q);
+
+    FreePosition(p);
+}
+
+void test_all_dbase(void) {
+    test_parse_san_promotions();
+    test_material_key();
+}
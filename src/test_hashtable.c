@@ -0,0 +1,332 @@
+/*
+
+    Amy - a chess playing program
+
+    Copyright (c) 2002-2025, Thorsten Greiner
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hashtable.h"
+#include "inline.h"
+#include "search.h"
+
+static void test_store_and_probe(void) {
+    hash_t key = 0x123456789abcdef0ULL;
+    move_t move = make_promotion(a7, b8, Queen, M_CAPTURE);
+    move_t bestm = M_NONE;
+    bool threat = false;
+    int score = 0;
+
+    StoreHT(key, 1234, 0, 2000, move, 37 * 16, true, 0);
+
+    assert(ProbeHT(key, &score, 37 * 16, &bestm, &threat, 0) == ExactScore);
+    assert(score == 1234);
+    assert(bestm == move);
+    assert(threat);
+
+    /* A deeper probe only yields the move. */
+    assert(ProbeHT(key, &score, 38 * 16, &bestm, &threat, 0) == Useful);
+    assert(bestm == move);
+}
+
+static void test_bounds_and_negative_scores(void) {
+    hash_t key = 0xfedcba9876543210ULL;
+    move_t move = make_move(e2, e4, M_PAWND);
+    move_t bestm = M_NONE;
+    bool threat = true;
+    int score = 0;
+
+    StoreHT(key, -777, -500, 0, move, 5 * 16, false, 0);
+
+    assert(ProbeHT(key, &score, 5 * 16, &bestm, &threat, 0) == UpperBound);
+    assert(score == -777);
+    assert(bestm == move);
+    assert(!threat);
+
+    StoreHT(key, 777, -500, 0, move, 6 * 16, false, 0);
+
+    assert(ProbeHT(key, &score, 6 * 16, &bestm, &threat, 0) == LowerBound);
+    assert(score == 777);
+}
+
+static void test_mate_scores(void) {
+    hash_t key = 0x0f0f0f0f12345678ULL;
+    move_t bestm = M_NONE;
+    bool threat = false;
+    int score = 0;
+
+    /* Mated at ply 10 seen from ply 4 ... */
+    StoreHT(key, -INF + 10, -INF, INF, M_NONE, 2 * 16, false, 4);
+
+    /* ... is mated at ply 12 when reached at ply 6. */
+    assert(ProbeHT(key, &score, 2 * 16, &bestm, &threat, 6) == ExactScore);
+    assert(score == -INF + 12);
+}
+
+static void test_bucket_sharing(void) {
+    /* All these keys map to the same bucket. */
+    hash_t base = 0x0badcafe00000000ULL;
+    int score;
+    move_t bestm;
+    bool threat;
+
+    ClearHashTable();
+
+    for (int i = 0; i < HT_BUCKET_SIZE; i++) {
+        StoreHT(base + i, 10 * i, -INF, INF, M_NONE, (i + 1) * 16, false, 0);
+    }
+
+    for (int i = 0; i < HT_BUCKET_SIZE; i++) {
+        assert(ProbeHT(base + i, &score, (i + 1) * 16, &bestm, &threat, 0) ==
+               ExactScore);
+        assert(score == 10 * i);
+    }
+
+    /* A full bucket replaces its shallowest entry. */
+    StoreHT(base + HT_BUCKET_SIZE, 42, -INF, INF, M_NONE, 8 * 16, false, 0);
+    assert(ProbeHT(base + HT_BUCKET_SIZE, &score, 8 * 16, &bestm, &threat, 0) ==
+           ExactScore);
+    assert(score == 42);
+    for (int i = 1; i < HT_BUCKET_SIZE; i++) {
+        assert(ProbeHT(base + i, &score, (i + 1) * 16, &bestm, &threat, 0) ==
+               ExactScore);
+    }
+    assert(ProbeHT(base, &score, 16, &bestm, &threat, 0) == Useless);
+}
+
+static void test_resize(void) {
+    hash_t deep = 0x0123456789abcdefULL;
+    hash_t shallow = 0xfedcba9876543210ULL;
+    int score;
+    move_t bestm;
+    bool threat;
+    char size[] = "1m";
+
+    ClearHashTable();
+    StoreHT(deep, 17, -INF, INF, M_NONE, 8 * 16, false, 0);
+    StoreHT(shallow, 23, -INF, INF, M_NONE, 16, false, 0);
+
+    ResizeHT(size, true);
+    assert(ProbeHT(deep, &score, 8 * 16, &bestm, &threat, 0) == ExactScore);
+    assert(score == 17);
+    assert(ProbeHT(shallow, &score, 16, &bestm, &threat, 0) == Useless);
+
+    ResizeHT(size, false);
+    assert(ProbeHT(deep, &score, 8 * 16, &bestm, &threat, 0) == Useless);
+}
+
+static void test_save_and_load(void) {
+    hash_t key = 0x0123456789abcdefULL;
+    const char *name = "test_hashtable.hash";
+    int score;
+    move_t bestm;
+    bool threat;
+    char small[] = "1m";
+    char large[] = "2m";
+
+    ResizeHT(small, false);
+    StoreHT(key, 17, -INF, INF, M_NONE, 8 * 16, false, 0);
+    assert(SaveHT(name));
+
+    /* Same size, the file is mapped. */
+    ClearHashTable();
+    assert(LoadHT(name));
+    assert(ProbeHT(key, &score, 8 * 16, &bestm, &threat, 0) == ExactScore);
+    assert(score == 17);
+
+    /* Different size, the entries are copied. */
+    ResizeHT(large, false);
+    assert(LoadHT(name));
+    assert(ProbeHT(key, &score, 8 * 16, &bestm, &threat, 0) == ExactScore);
+    assert(score == 17);
+
+    remove(name);
+}
+
+static void test_save_to_loaded_file(void) {
+    hash_t key = 0x0123456789abcdefULL;
+    hash_t other = 0xfedcba9876543210ULL;
+    const char *name = "test_hashtable.hash";
+    int score;
+    move_t bestm;
+    bool threat;
+    char size[] = "1m";
+
+    ResizeHT(size, false);
+    StoreHT(key, 17, -INF, INF, M_NONE, 8 * 16, false, 0);
+    assert(SaveHT(name));
+
+    /* Save back to the file the table is mapped from. */
+    assert(LoadHT(name));
+    StoreHT(other, 23, -INF, INF, M_NONE, 8 * 16, false, 0);
+    assert(SaveHT(name));
+    assert(ProbeHT(key, &score, 8 * 16, &bestm, &threat, 0) == ExactScore);
+    assert(score == 17);
+    assert(ProbeHT(other, &score, 8 * 16, &bestm, &threat, 0) == ExactScore);
+    assert(score == 23);
+
+    ClearHashTable();
+    assert(LoadHT(name));
+    assert(ProbeHT(other, &score, 8 * 16, &bestm, &threat, 0) == ExactScore);
+    assert(score == 23);
+
+    remove(name);
+}
+
+static void test_pawn_table_invalidation(void) {
+    hash_t key = 0x0123456789abcdefULL;
+    struct PawnFacts pf = {0};
+    int score;
+
+    StorePT(key, 42, &pf);
+    StoreST(key, 17);
+    assert(ProbePT(key, &score, &pf) == Useful);
+    assert(score == 42);
+    assert(ProbeST(key, &score) == Useful);
+    assert(score == 17);
+
+    ClearPawnHashTable();
+    assert(ProbePT(key, &score, &pf) == Useless);
+    assert(ProbeST(key, &score) == Useless);
+}
+
+static void test_eval_entry_packing(void) {
+    hash_t key = 0x1122334455667788ULL;
+    struct PawnFacts pf = {.pf_WhitePassers = 0x0000ff0000000100ULL,
+                           .pf_BlackPassers = 0x0080000000ff0000ULL,
+                           .pf_Flags = 0x7f,
+                           .pf_WhiteKingSide = -3,
+                           .pf_BlackKingSide = 12,
+                           .pf_WhiteQueenSide = 127,
+                           .pf_BlackQueenSide = -128};
+    struct PawnFacts out;
+    int score;
+
+    StorePT(key, -1234, &pf);
+    assert(ProbePT(key, &score, &out) == Useful);
+    assert(score == -1234);
+    assert(out.pf_WhitePassers == pf.pf_WhitePassers);
+    assert(out.pf_BlackPassers == pf.pf_BlackPassers);
+    assert(out.pf_Flags == pf.pf_Flags);
+    assert(out.pf_WhiteKingSide == pf.pf_WhiteKingSide);
+    assert(out.pf_BlackKingSide == pf.pf_BlackKingSide);
+    assert(out.pf_WhiteQueenSide == pf.pf_WhiteQueenSide);
+    assert(out.pf_BlackQueenSide == pf.pf_BlackQueenSide);
+
+    StoreST(key, -32768);
+    assert(ProbeST(key, &score) == Useful);
+    assert(score == -32768);
+
+    /* Scores which do not fit into 16 bits are not stored. */
+    StoreST(key ^ 1, 40000);
+    assert(ProbeST(key ^ 1, &score) == Useless);
+
+    /* A key differing only in the signature bits does not match. */
+    assert(ProbeST(key ^ (1ULL << 63), &score) == Useless);
+    assert(ProbePT(key ^ (1ULL << 63), &score, &out) == Useless);
+}
+
+#if MP
+static void test_in_flight(void) {
+    hash_t key = 0x0123456789abcdefULL;
+
+    assert(EnterInFlight(key, 5 * 16, true) == IF_ENTERED);
+
+    /* A second thread defers the node, or searches it too. */
+    assert(EnterInFlight(key, 5 * 16, true) == IF_BUSY);
+    assert(EnterInFlight(key, 5 * 16, false) == IF_ENTERED);
+
+    /* The same position at a different depth is a different node. */
+    assert(EnterInFlight(key, 6 * 16, true) == IF_ENTERED);
+    LeaveInFlight(key, 6 * 16);
+
+    LeaveInFlight(key, 5 * 16);
+    assert(EnterInFlight(key, 5 * 16, true) == IF_BUSY);
+    LeaveInFlight(key, 5 * 16);
+    assert(EnterInFlight(key, 5 * 16, true) == IF_ENTERED);
+    LeaveInFlight(key, 5 * 16);
+}
+#endif
+
+#if MP && HAVE_LIBPTHREAD
+static void test_eval_cache(void) {
+    hash_t key = 0x0fedcba987654321ULL;
+    struct PawnFacts pf = {0};
+    int score;
+    bool local = LocalEvalCaches;
+
+    LocalEvalCaches = true;
+    struct EvalCache *ec = GetEvalCache(0);
+    assert(ec != NULL);
+
+    /* Entries stored through a private cache are not seen by others. */
+    UseEvalCache(ec);
+    StorePT(key, 42, &pf);
+    StoreST(key, 17);
+    assert(ProbePT(key, &score, &pf) == Useful);
+    assert(score == 42);
+    assert(ProbeST(key, &score) == Useful);
+    assert(score == 17);
+
+    UseEvalCache(NULL);
+    assert(ProbePT(key, &score, &pf) == Useless);
+    assert(ProbeST(key, &score) == Useless);
+
+    /* ClearPawnHashTable() invalidates the private caches too. */
+    UseEvalCache(ec);
+    ClearPawnHashTable();
+    assert(ProbePT(key, &score, &pf) == Useless);
+    UseEvalCache(NULL);
+
+    LocalEvalCaches = false;
+    assert(GetEvalCache(0) == NULL);
+    LocalEvalCaches = local;
+}
+#endif
+
+void test_all_hashtable(void) {
+    AllocateHT();
+
+    test_store_and_probe();
+    test_bounds_and_negative_scores();
+    test_mate_scores();
+    test_bucket_sharing();
+    test_resize();
+    test_save_and_load();
+    test_save_to_loaded_file();
+    test_pawn_table_invalidation();
+    test_eval_entry_packing();
+#if MP
+    test_in_flight();
+#endif
+#if MP && HAVE_LIBPTHREAD
+    test_eval_cache();
+#endif
+}
@@ -40,13 +40,21 @@
 #include "time_ctl.h"
 #include "utils.h"
 
-int TMoves = 60, TTime = 5 * 60;
-int Moves[3] = {60, 60}, Time[3] = {5 * 60, 5 * 60};
+/*
+ * All times are in GetTime() units (milliseconds).
+ */
+
+int TMoves = 60, TTime = 5 * 60 * ONE_SECOND;
+int Moves[3] = {60, 60};
+int Time[3] = {5 * 60 * ONE_SECOND, 5 * 60 * ONE_SECOND};
 int TMoves2, TTime2;
 int TwoTimeControls = false;
 
 int Increment = 0;
 
+/* Time lost per move in communication with the GUI */
+int MoveOverhead = 10;
+
 struct SingleTimeControl {
     int moves;
     int total_time;
@@ -60,9 +68,10 @@ struct TimeControl {
 };
 
 /** Stores the single global time control. */
-static struct TimeControl globalTimeControl = {.first.moves = 60,
-                                               .first.total_time = 5 * 60,
-                                               .hasSecondTimeControl = false};
+static struct TimeControl globalTimeControl = {
+    .first.moves = 60,
+    .first.total_time = 5 * 60 * ONE_SECOND,
+    .hasSecondTimeControl = false};
 
 void DoTC(struct Position *p, int mtime) {
     Time[p->turn] += -mtime + Increment;
@@ -82,30 +91,40 @@ void DoTC(struct Position *p, int mtime) {
     }
 }
 
+/**
+ * Calculate the soft and hard time limit in seconds for the next move.
+ * The move overhead is kept in reserve.
+ */
 void CalcTime(struct Position *p, float *soft, float *hard) {
     char time_as_text[16];
     if (TMoves >= 0) {
+        float time_left = (float)(Time[p->turn] - MoveOverhead) / ONE_SECOND;
+        float ttime = (float)TTime / ONE_SECOND;
+        float increment = (float)Increment / ONE_SECOND;
+
+        if (time_left < 0.0)
+            time_left = 0.0;
+
         if (Moves[p->turn] > 0) {
             /*  int limit = (13*TTime/TMoves)/8 + (3*Increment)/4;  */
-            float limit = (1.625 * TTime / TMoves) + (0.85 * Increment);
+            float limit = (1.625 * ttime / TMoves) + (0.85 * increment);
 
             Print(1, "TC: %d moves in %s\n", Moves[p->turn],
-                  FormatTime((unsigned int)(Time[p->turn]) * ONE_SECOND,
-                             time_as_text, sizeof(time_as_text)));
+                  FormatTime((unsigned int)Time[p->turn], time_as_text,
+                             sizeof(time_as_text)));
             /*  *soft = (7*Time[p->turn]/Moves[p->turn])/8 + (3*Increment)/4; */
-            *soft =
-                (0.875 * Time[p->turn] / Moves[p->turn]) + (0.75 * Increment);
+            *soft = (0.875 * time_left / Moves[p->turn]) + (0.75 * increment);
             if (*soft > limit)
                 *soft = limit;
 
             if (TwoTimeControls && Moves[p->turn] <= 5) {
                 int moves = TMoves2;
-                int soft2;
+                float soft2;
                 if (moves == 0)
                     moves = 60;
-                soft2 = TTime2 / moves;
+                soft2 = (float)TTime2 / ONE_SECOND / moves;
                 /*    *soft = ((*soft)+(float)soft2)/2;    */
-                *soft = 0.5 * ((*soft) + (float)soft2);
+                *soft = 0.5 * ((*soft) + soft2);
                 Print(1, "Adjusted timing to %.4f secs\n", *soft);
             }
             *hard = 4.0 * (*soft);
@@ -115,30 +134,34 @@ void CalcTime(struct Position *p, float *soft, float *hard) {
              */
             /*  rearrange equation to eliminate floating point division  */
             /*  1.625 / 60 = 0.0271  */
-            float limit = 0.0271 * ((float)Time[p->turn] + 60 * Increment);
+            float limit = 0.0271 * (time_left + 60 * increment);
 
             Print(1, "TC: all moves in %s\n",
-                  FormatTime((unsigned int)(Time[p->turn]) * ONE_SECOND,
-                             time_as_text, sizeof(time_as_text)));
+                  FormatTime((unsigned int)Time[p->turn], time_as_text,
+                             sizeof(time_as_text)));
             /*  0.875 / 60.0 = 0.0146  */
-            *soft = 0.0146 * (float)Time[p->turn] + (0.85 * Increment);
+            *soft = 0.0146 * time_left + (0.85 * increment);
             if (*soft > limit)
                 *soft = limit;
             *hard = 4.0 * (*soft);
         }
-        if (*hard > Time[p->turn])
-            *hard = 0.5 * (float)Time[p->turn];
+        if (*hard > time_left)
+            *hard = 0.5 * time_left;
         if (*soft > *hard)
             *soft = 0.67 * (*hard);
 
-        Print(1, "TL: %.2f/%.2f\n", *soft, *hard);
+        Print(1, "TL: %.3f/%.3f\n", *soft, *hard);
     } else {
-        *soft = *hard = (float)TTime;
+        int budget = TTime - MoveOverhead;
+        if (budget < TTime / 2)
+            budget = TTime / 2;
+        *soft = *hard = (float)budget / ONE_SECOND;
     }
 }
 
 static struct TimeControl parse_timecontrol_xboard(char *args[]) {
-    int ttmoves, ttime, tminutes, tseconds, inc = 0;
+    int ttmoves, ttime, tminutes, tseconds;
+    double inc = 0.0;
 
     sscanf(args[0], "%d", &ttmoves);
     char *colon = strchr(args[1], ':'); /* check for time in xx:yy format */
@@ -149,11 +172,11 @@ static struct TimeControl parse_timecontrol_xboard(char *args[]) {
         sscanf(args[1], "%d", &tminutes);
         ttime = tminutes * 60;
     }
-    sscanf(args[2], "%d", &inc);
+    sscanf(args[2], "%lf", &inc); /* the increment may be fractional */
 
     struct TimeControl result = {.first.moves = ttmoves,
-                                 .first.total_time = ttime,
-                                 .first.increment = inc,
+                                 .first.total_time = ttime * ONE_SECOND,
+                                 .first.increment = (int)(inc * ONE_SECOND),
                                  .hasSecondTimeControl = false};
 
     return result;
@@ -166,7 +189,8 @@ static const char *const sudden_death = "sd";
 static const char *const fixed = "fixed";
 
 static struct TimeControl parse_timecontrol(char *args[]) {
-    int ttmoves, ttime, inc = 0;
+    int ttmoves;
+    double ttime, inc = 0.0;
     int ttmoves2, ttime2;
 
     struct TimeControl result = globalTimeControl;
@@ -181,10 +205,10 @@ static struct TimeControl parse_timecontrol(char *args[]) {
             sscanf(x, "%d", &ttmoves);
         x = strtok(NULL, "/ \t\n\r");
         if (x) {
-            sscanf(x, "%d", &ttime);
+            sscanf(x, "%lf", &ttime);
             for (x++; *x; x++) {
                 if (*x == '+') {
-                    sscanf(x + 1, "%d", &inc);
+                    sscanf(x + 1, "%lf", &inc);
                     break;
                 }
             }
@@ -205,19 +229,19 @@ static struct TimeControl parse_timecontrol(char *args[]) {
             }
             if (ttmoves >= 0) {
                 result.first.moves = ttmoves;
-                result.first.total_time = ttime * 60;
-                result.first.increment = inc;
+                result.first.total_time = (int)(ttime * 60 * ONE_SECOND);
+                result.first.increment = (int)(inc * ONE_SECOND);
                 result.hasSecondTimeControl = false;
 
             } else {
                 result.first.moves = -1;
-                result.first.total_time = ttime;
+                result.first.total_time = (int)(ttime * ONE_SECOND);
                 result.first.increment = 0;
                 result.hasSecondTimeControl = false;
             }
             if (TwoTimeControls) {
                 result.second.moves = ttmoves2;
-                result.second.total_time = ttime2 * 60;
+                result.second.total_time = ttime2 * 60 * ONE_SECOND;
                 result.second.increment = 0;
                 result.hasSecondTimeControl = true;
             }
@@ -271,17 +295,19 @@ void ResetTimeControl(bool verbose) {
                 Print(0, "%d ", globalTimeControl.first.moves);
 
             if (globalTimeControl.first.increment) {
-                Print(0, "moves in %d mins + %d secs Increment\n",
-                      globalTimeControl.first.total_time / 60,
-                      globalTimeControl.first.increment);
+                Print(0, "moves in %g mins + %g secs Increment\n",
+                      (double)globalTimeControl.first.total_time /
+                          (60 * ONE_SECOND),
+                      (double)globalTimeControl.first.increment / ONE_SECOND);
             } else {
-                Print(0, "moves in %d mins\n",
-                      globalTimeControl.first.total_time / 60);
+                Print(0, "moves in %g mins\n",
+                      (double)globalTimeControl.first.total_time /
+                          (60 * ONE_SECOND));
             }
 
         } else {
-            Print(0, "%d seconds/move fixed time\n",
-                  globalTimeControl.first.total_time);
+            Print(0, "%g seconds/move fixed time\n",
+                  (double)globalTimeControl.first.total_time / ONE_SECOND);
         }
 
         if (globalTimeControl.hasSecondTimeControl) {
@@ -291,7 +317,7 @@ void ResetTimeControl(bool verbose) {
             else
                 Print(0, "%d ", globalTimeControl.second.moves);
             Print(0, "moves in %d mins\n",
-                  globalTimeControl.second.total_time / 60);
+                  globalTimeControl.second.total_time / (60 * ONE_SECOND));
         }
     }
 }
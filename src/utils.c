@@ -36,6 +36,7 @@
 
 #include <limits.h>
 #include <stdarg.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -44,12 +45,17 @@
 #endif
 #include <time.h>
 
+#if HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
 #include "amy.h"
 #include "search.h"
 #include "utils.h"
 
 FILE *LogFile = NULL;
 int Verbosity = 9;
+static bool InputIgnored = false;
 
 /**
  * Open a log file, remember fp in global variable LogFile
@@ -61,6 +67,16 @@ void OpenLogFile(char *name) {
     LogFile = fopen(name, "w");
 }
 
+/**
+ * Stop writing to the log file.
+ */
+void CloseLogFile(void) {
+    if (LogFile) {
+        fclose(LogFile);
+        LogFile = NULL;
+    }
+}
+
 /**
  * Print something to stdout and to the logfile.
  */
@@ -94,15 +110,103 @@ void CDECL PrintNoLog(int vb, char *fmt, ...) {
     va_end(va);
 }
 
+#if INPUT_THREAD
+
+/*
+ * Input is read by a thread of its own, which blocks on stdin and queues
+ * the lines read. The search only looks at InputPending, so it does no
+ * system calls for input and notices commands right away.
+ */
+
+#define INPUT_QUEUE_SIZE 16
+#define INPUT_LINE_SIZE 1024
+
+static char InputQueue[INPUT_QUEUE_SIZE][INPUT_LINE_SIZE];
+static unsigned int InputHead = 0, InputTail = 0;
+static bool InputEOF = false;
+static bool InputThreadStarted = false;
+static pthread_mutex_t InputMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t InputChanged = PTHREAD_COND_INITIALIZER;
+
+atomic_bool InputPending = false;
+
+static void *InputLoop(void *x) {
+    (void)x;
+    char line[INPUT_LINE_SIZE];
+    bool eof = false;
+
+    while (!eof) {
+        eof = fgets(line, sizeof(line), stdin) == NULL;
+
+        pthread_mutex_lock(&InputMutex);
+        if (eof) {
+            InputEOF = true;
+        } else {
+            while (InputTail - InputHead == INPUT_QUEUE_SIZE) {
+                pthread_cond_wait(&InputChanged, &InputMutex);
+            }
+            strcpy(InputQueue[InputTail % INPUT_QUEUE_SIZE], line);
+            InputTail++;
+            atomic_store(&InputPending, !InputIgnored);
+        }
+        pthread_cond_broadcast(&InputChanged);
+        pthread_mutex_unlock(&InputMutex);
+    }
+
+    return NULL;
+}
+
+#endif /* INPUT_THREAD */
+
+/**
+ * Start reading stdin in a thread of its own, if threads are available.
+ * From then on input must be read with ReadLine() only.
+ */
+void StartInputThread(void) {
+#if INPUT_THREAD
+    pthread_t thread;
+
+    if (InputThreadStarted)
+        return;
+
+    if (pthread_create(&thread, NULL, &InputLoop, NULL) == 0) {
+        pthread_detach(thread);
+        InputThreadStarted = true;
+    }
+#endif /* INPUT_THREAD */
+}
+
 /**
- * Read a line from stdin.
+ * Read a line from stdin. Returns 0 at end of input.
  */
 int ReadLine(char *buffer, int cnt) {
+#if INPUT_THREAD
+    if (InputThreadStarted) {
+        pthread_mutex_lock(&InputMutex);
+        while (InputHead == InputTail && !InputEOF) {
+            pthread_cond_wait(&InputChanged, &InputMutex);
+        }
+
+        int result = InputHead != InputTail;
+        if (result) {
+            strncpy(buffer, InputQueue[InputHead % INPUT_QUEUE_SIZE], cnt - 1);
+            buffer[cnt - 1] = '\0';
+            InputHead++;
+            atomic_store(&InputPending,
+                         !InputIgnored && InputHead != InputTail);
+            pthread_cond_broadcast(&InputChanged);
+        }
+        pthread_mutex_unlock(&InputMutex);
+
+        return result;
+    }
+#endif /* INPUT_THREAD */
+
     return fgets(buffer, cnt, stdin) != NULL;
 }
 
 /**
- * Convert an int representing a time in seconds to a string.
+ * Convert a time in GetTime() units to a string.
  */
 char *FormatTime(unsigned int secs, char *buffer, size_t len) {
     if (secs >= 60 * ONE_SECOND) {
@@ -118,7 +222,7 @@ char *FormatTime(unsigned int secs, char *buffer, size_t len) {
         else
             snprintf(buffer, len, "  %d:%02d", mins, secs);
     } else {
-        int tsecs = (secs % ONE_SECOND) / 10;
+        int tsecs = (secs % ONE_SECOND) / (ONE_SECOND / 10);
         secs = secs / ONE_SECOND;
 
         snprintf(buffer, len, "  %2d.%d", secs, tsecs);
@@ -186,19 +290,39 @@ char *FormatCount(unsigned long count, char *buffer, size_t len) {
 }
 
 /**
- * Get the current time.
+ * Get the current time in milliseconds. Where available a monotonic clock
+ * is used, which does not jump when the system time is set. The time is
+ * counted from one second before the first call, so it never is 0 and
+ * wraps only after 49 days of running.
  */
 unsigned int GetTime(void) {
-#if HAVE_GETTIMEOFDAY
-    static struct timeval timeval;
-    unsigned int now;
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+    static struct timespec start;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (start.tv_sec == 0 && start.tv_nsec == 0) {
+        start = now;
+        start.tv_sec -= 1;
+    }
+
+    return (unsigned int)((now.tv_sec - start.tv_sec) * 1000 +
+                          (now.tv_nsec - start.tv_nsec) / 1000000L);
+#elif HAVE_GETTIMEOFDAY
+    static struct timeval start;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    if (start.tv_sec == 0 && start.tv_usec == 0) {
+        start = now;
+        start.tv_sec -= 1;
+    }
 
-    gettimeofday(&timeval, NULL);
-    now = timeval.tv_sec * 100 + (timeval.tv_usec / 10000L);
-    return now;
+    return (unsigned int)((now.tv_sec - start.tv_sec) * 1000 +
+                          (now.tv_usec - start.tv_usec) / 1000L);
 #else
 #ifdef _WIN32
-    return ((unsigned int)GetTickCount() / 10);
+    return (unsigned int)GetTickCount();
 #else
 #error TIME COUNTING MUST BE IMPLEMENTED
 #endif
@@ -221,9 +345,45 @@ void GetTmpFileName(char *file_name, size_t len) {
     }
 }
 /**
- * Check if we can read from stdin without blocking.
+ * Do not let input interrupt a search while 'ignore' is true. Lines read
+ * meanwhile are kept.
+ */
+void IgnoreInput(bool ignore) {
+#if INPUT_THREAD
+    pthread_mutex_lock(&InputMutex);
+    InputIgnored = ignore;
+    atomic_store(&InputPending, !ignore && InputHead != InputTail);
+    pthread_mutex_unlock(&InputMutex);
+#else
+    InputIgnored = ignore;
+#endif /* INPUT_THREAD */
+}
+
+/**
+ * Stop looking at stdin for good, for worker processes created by fork()
+ * that share it with their parent. The input thread does not exist there.
+ */
+void DetachInput(void) {
+    InputIgnored = true;
+#if INPUT_THREAD
+    InputThreadStarted = false;
+    atomic_store(&InputPending, false);
+#endif /* INPUT_THREAD */
+}
+
+/**
+ * Check if we can read a line without blocking.
  */
 int InputReady(void) {
+    if (InputIgnored)
+        return 0;
+
+#if INPUT_THREAD
+    if (InputThreadStarted) {
+        return InputWaiting();
+    }
+#endif /* INPUT_THREAD */
+
 #if HAVE_SELECT
     fd_set rfd;
     struct timeval timeout;